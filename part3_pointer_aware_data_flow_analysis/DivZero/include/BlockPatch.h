@@ -0,0 +1,30 @@
+#ifndef BLOCK_PATCH_H
+#define BLOCK_PATCH_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Function.h"
+
+using namespace llvm;
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Block Patching
+//===----------------------------------------------------------------------===//
+
+/**
+ * Give Old the body of New while keeping every block of Old that New has
+ * unchanged, so states solved for those blocks stay attached to them. Blocks
+ * are paired by label and compared as printed IR, ignoring metadata numbers.
+ * The other blocks of New are moved into Old and Old's own are erased; New is
+ * left without a body. Changed receives what reanalyze() needs to be told
+ * about: the moved blocks and the kept blocks that lost a predecessor.
+ *
+ * Returns false, and changes nothing, if the two signatures or argument names
+ * differ.
+ */
+bool patchChangedBlocks(Function &Old, Function &New,
+                        SmallVectorImpl<BasicBlock *> &Changed);
+} // namespace dataflow
+
+#endif // BLOCK_PATCH_H
@@ -0,0 +1,53 @@
+#ifndef CHECKER_H
+#define CHECKER_H
+
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/Registry.h"
+#include <memory>
+#include <vector>
+
+#include "Domain.h"
+
+using namespace llvm;
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Checkers
+//===----------------------------------------------------------------------===//
+
+/**
+ * A client of the solved zero/non-zero facts. DivZeroAnalysis solves each
+ * function once and hands the state of every checked value to all enabled
+ * checkers, so adding a checker does not add a fixpoint run.
+ *
+ * New checkers register themselves with CheckerRegistry::Add and are picked
+ * with -divzero-checkers.
+ */
+class Checker {
+public:
+  virtual ~Checker() = default;
+
+  /// Rule id used in reports.
+  virtual StringRef getName() const = 0;
+
+  /// What a finding of this checker means, as shown in reports.
+  virtual StringRef getMessage() const = 0;
+
+  /// The value whose state decides whether I is a finding, or null if this
+  /// checker does not look at I.
+  virtual Value *getCheckedValue(Instruction *I) const = 0;
+
+  /// Decide I given the state of its checked value right before I.
+  virtual bool check(Instruction *I, Domain *State) const {
+    return State->Value != Domain::NonZero;
+  }
+};
+
+using CheckerRegistry = Registry<Checker>;
+
+/// Instantiate the checkers named by -divzero-checkers (default: divzero).
+std::vector<std::unique_ptr<Checker>> createEnabledCheckers();
+} // namespace dataflow
+
+#endif // CHECKER_H
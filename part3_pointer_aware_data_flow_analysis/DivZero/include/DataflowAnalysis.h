@@ -1,7 +1,10 @@
 #ifndef DATAFLOW_ANALYSIS_H
 #define DATAFLOW_ANALYSIS_H
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/IR/CFG.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/InstIterator.h"
@@ -16,6 +19,7 @@
 
 #include "Domain.h"
 #include "PointerAnalysis.h"
+#include "Reporter.h"
 
 using namespace llvm;
 
@@ -26,21 +30,112 @@ using Memory = std::map<std::string, Domain *>;
 std::string variable(Value *);
 std::string address(Value *);
 
+/**
+ * Keeps a state with the instruction it was computed for: the state of an
+ * erased instruction is freed instead of leaked, and it does not move over
+ * to the value the instruction was replaced with.
+ */
+struct StateMapConfig : ValueMapConfig<Instruction *> {
+  enum { FollowRAUW = false };
+  struct ExtraData {
+    ValueMap<Instruction *, Memory *, StateMapConfig> *Map;
+  };
+  static void onDelete(const ExtraData &Data, Instruction *I);
+};
+using StateMap = ValueMap<Instruction *, Memory *, StateMapConfig>;
+
+inline void StateMapConfig::onDelete(const ExtraData &Data, Instruction *I) {
+  auto It = Data.Map->find(I);
+  if (It != Data.Map->end())
+    delete It->second;
+}
+
 struct DataflowAnalysis : public FunctionPass {
-  ValueMap<Instruction *, Memory *> InMap;
-  ValueMap<Instruction *, Memory *> OutMap;
+  StateMap InMap;
+  StateMap OutMap;
   SetVector<Instruction *> ErrorInsts;
 
   DataflowAnalysis(char ID);
+  ~DataflowAnalysis() override;
   void collectErrorInsts(Function &F);
+
+  /**
+   * Solve F and fill InMap, OutMap and ErrorInsts without printing anything.
+   * The results stay valid until the next call or releaseMemory(). SE is
+   * optional and only used while solving.
+   */
+  void analyze(Function &F, PointerAnalysis *PA, ScalarEvolution *SE = nullptr);
+
+  /**
+   * Bring the results of analyze() up to date after the blocks in Changed
+   * were edited. Only Changed and the blocks reachable from them are reset
+   * and solved again; every other state keeps its converged value, so the
+   * cost follows the size of the affected region. Instructions may only have
+   * been added to or erased from Changed blocks, new blocks and blocks that
+   * lost a predecessor must be listed in Changed, and PA must be the
+   * points-to result of the edited function.
+   */
+  void reanalyze(Function &F, PointerAnalysis *PA,
+                 ArrayRef<BasicBlock *> Changed,
+                 ScalarEvolution *SE = nullptr);
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+  bool doInitialization(Module &M) override;
   bool runOnFunction(Function &F) override;
+  bool doFinalization(Module &M) override;
+  void releaseMemory() override;
+  virtual std::string getAnalysisName() = 0;
+
+  /// Abstract value that made I a finding, or null if there is none to show.
+  virtual Domain *getFindingState(Instruction *I) { return nullptr; }
+
+  /// Rule id I is reported under.
+  virtual std::string getFindingRule(Instruction *I) {
+    return getAnalysisName();
+  }
+
+  /// Message I is reported with.
+  virtual std::string getFindingMessage(Instruction *I) {
+    return "Potential error found by " + getAnalysisName();
+  }
 
 protected:
+  // Loop facts for the function being analyzed, null if unavailable.
+  ScalarEvolution *SE = nullptr;
+
+  // Set while reanalyze() runs: the blocks whose states were reset.
+  bool Incremental = false;
+  SmallPtrSet<BasicBlock *, 16> Affected;
+
+  /**
+   * Add BB and every block reachable from it to Affected, resetting their
+   * states. doAnalysis calls this during reanalyze() when something the
+   * states of an unchanged block were computed from differs after the edit.
+   */
+  void markChanged(BasicBlock *BB);
+
   virtual void transfer(Instruction *I, const Memory *In, Memory *NOut,
                         PointerAnalysis *PA, SetVector<Value *> PointerSet) = 0;
   virtual void doAnalysis(Function &F, PointerAnalysis *PA) = 0;
   virtual bool check(Instruction *I) = 0;
-  virtual std::string getAnalysisName() = 0;
+
+  /**
+   * Drive the worklist of F with Step, which visits one instruction and
+   * inserts the successors whose input changed into the worklist. With
+   * -divzero-threads > 1 the CFG is split into strongly connected regions and
+   * every region is iterated to its fixpoint once all regions feeding it are
+   * done, so regions that do not depend on each other run concurrently.
+   * Step must then only look up InMap/OutMap entries with find(), and
+   * instructions it inserts outside the current region are dropped. During
+   * reanalyze() only the Affected blocks are seeded, serially.
+   */
+  void solve(Function &F,
+             function_ref<void(Instruction *, SetVector<Instruction *> &)> Step);
+
+private:
+  // Structured report requested with -divzero-report, open for the module.
+  std::unique_ptr<Reporter> Report;
+  // Points-to facts of the module with -divzero-module-pta, else null.
+  std::unique_ptr<ModulePointerAnalysis> ModulePTA;
 };
 
 
@@ -1,12 +1,25 @@
 #ifndef DIV_ZERO_ANALYSIS_H
 #define DIV_ZERO_ANALYSIS_H
 
+#include "llvm/ADT/SmallBitVector.h"
+
+#include "Checker.h"
 #include "DataflowAnalysis.h"
+#include "DivisionSlice.h"
+#include "Induction.h"
 
 namespace dataflow {
 struct DivZeroAnalysis : public DataflowAnalysis {
   static char ID;
-  DivZeroAnalysis() : DataflowAnalysis(ID) {}
+  DivZeroAnalysis() : DataflowAnalysis(ID), Checkers(createEnabledCheckers()) {}
+
+  std::string getAnalysisName() override { return "DivZero"; }
+
+  /// State of the value the first applicable checker looks at, right before I.
+  Domain *getFindingState(Instruction *I) override;
+  std::string getFindingRule(Instruction *I) override;
+  std::string getFindingMessage(Instruction *I) override;
+  void releaseMemory() override;
 
 protected:
   void transfer(Instruction *I, const Memory *In, Memory *NOut,
@@ -21,7 +34,122 @@ protected:
 
   bool check(Instruction *I) override;
 
-  std::string getAnalysisName() override { return "DivZero"; }
+private:
+  /// State of V right before I executes.
+  Domain *getStateBefore(Instruction *I, Value *V);
+
+  /// True if the edge From -> To may be taken, as far as solved so far.
+  bool isFeasibleEdge(BasicBlock *From, BasicBlock *To);
+  /// True if some feasible edge reaches BB, or BB is the entry block.
+  bool isExecutable(BasicBlock *BB);
+  /// Mark the successors Term can take under In and queue their blocks.
+  void markFeasibleSuccessors(Instruction *Term, const Memory *In,
+                              SetVector<Instruction *> &WorkSet);
+
+  /// True if I would not be transferred the way its current states were.
+  bool factsChanged(Instruction *I, const DivisionSlice *NewSlice,
+                    const DenseMap<Instruction *, std::vector<std::string>>
+                        &NewDeadKeys,
+                    const InductionInfo *NewInduction);
+
+  // What the current states were solved with, kept so reanalyze() can tell
+  // which unchanged blocks are still valid. Null if not computed.
+  bool Solved = false;
+  std::unique_ptr<DivisionSlice> Slice;
+  DenseMap<Instruction *, std::vector<std::string>> DeadKeys;
+  std::unique_ptr<InductionInfo> Induction;
+  hash_code SolvedPA;
+  std::vector<std::string> PointerKeys;
+  DenseMap<Instruction *, std::string> ValueKeys;
+
+  // Successors each terminator has been found to take. Empty when branch
+  // pruning is off, in which case every edge is feasible.
+  DenseMap<Instruction *, SmallBitVector> FeasibleSuccs;
+
+  // All enabled checkers share the states solved by doAnalysis.
+  std::vector<std::unique_ptr<Checker>> Checkers;
+  DenseMap<Instruction *, const Checker *> FindingCheckers;
+};
+
+/**
+ * New pass manager analysis wrapping DivZeroAnalysis. The solved states stay
+ * cached in the FunctionAnalysisManager until a pass reports that it changed
+ * the function, so later passes can query them without re-solving.
+ */
+class DivZeroAnalysisPass : public AnalysisInfoMixin<DivZeroAnalysisPass> {
+public:
+  class Result {
+  public:
+    explicit Result(std::unique_ptr<DivZeroAnalysis> DZ) : DZ(std::move(DZ)) {}
+
+    const SetVector<Instruction *> &getErrorInsts() const {
+      return DZ->ErrorInsts;
+    }
+
+    /// The abstract state right before I, or null if I is not in the function.
+    const Memory *getInState(Instruction *I) const {
+      auto It = DZ->InMap.find(I);
+      return It == DZ->InMap.end() ? nullptr : It->second;
+    }
+
+    Domain *getFindingState(Instruction *I) const {
+      return DZ->getFindingState(I);
+    }
+
+    std::string getFindingRule(Instruction *I) const {
+      return DZ->getFindingRule(I);
+    }
+
+    std::string getFindingMessage(Instruction *I) const {
+      return DZ->getFindingMessage(I);
+    }
+
+    /**
+     * Bring the cached states up to date after the blocks in Changed were
+     * edited; see DataflowAnalysis::reanalyze(). The caller must keep this
+     * result from being invalidated by the edit.
+     */
+    void reanalyze(Function &F, PointerAnalysis &PA,
+                   ArrayRef<BasicBlock *> Changed, ScalarEvolution *SE) {
+      DZ->reanalyze(F, &PA, Changed, SE);
+    }
+
+  private:
+    std::unique_ptr<DivZeroAnalysis> DZ;
+  };
+
+  Result run(Function &F, FunctionAnalysisManager &FAM);
+
+private:
+  friend AnalysisInfoMixin<DivZeroAnalysisPass>;
+  static AnalysisKey Key;
+};
+
+/**
+ * Prints the same report as the legacy -DivZero pass from the cached
+ * analysis results. Registered as "divzero" for `opt -passes=`. Without a
+ * stream it prints to textReportStream(), chosen when the pass first runs.
+ */
+class DivZeroPrinterPass : public PassInfoMixin<DivZeroPrinterPass> {
+public:
+  DivZeroPrinterPass() : OS(nullptr) {}
+  explicit DivZeroPrinterPass(raw_ostream &OS) : OS(&OS) {}
+  PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM);
+  static bool isRequired() { return true; }
+
+private:
+  raw_ostream *OS;
+};
+
+/**
+ * Streams the findings of every function in the module through a Reporter.
+ * Registered as "divzero-report"; writes to -divzero-report, or to stdout if
+ * that is not set.
+ */
+class DivZeroReportPass : public PassInfoMixin<DivZeroReportPass> {
+public:
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+  static bool isRequired() { return true; }
 };
 } // namespace dataflow
 
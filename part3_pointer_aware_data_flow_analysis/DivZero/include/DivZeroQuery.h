@@ -0,0 +1,114 @@
+#ifndef DIV_ZERO_QUERY_H
+#define DIV_ZERO_QUERY_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/PassManager.h"
+#include <string>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "Domain.h"
+#include "Induction.h"
+#include "PointerAnalysis.h"
+
+using namespace llvm;
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Demand-Driven DivZero Queries
+//===----------------------------------------------------------------------===//
+
+/**
+ * Answers "can this division's divisor be zero?" without solving the whole
+ * function. A query walks backward from the divisor through its def-use chain
+ * and through the stores that may reach each load, and only the facts found
+ * that way are solved, with the same transfer rules and worklist order as
+ * DivZeroAnalysis so the verdict matches check().
+ *
+ * Facts are kept once their query has converged, so later queries on the same
+ * function only solve what earlier ones have not.
+ */
+class DivZeroQuery {
+public:
+  DivZeroQuery(Function &F, PointerAnalysis &PA,
+               ScalarEvolution *SE = nullptr);
+
+  /// Abstract value of the integer V; SSA values are the same at every use.
+  Domain *getValueState(llvm::Value *V);
+
+  /// True if some path from the entry may reach BB.
+  bool isReachable(BasicBlock *BB);
+
+  /// Cached facts refer to the points-to result, so drop them together.
+  bool invalidate(Function &F, const PreservedAnalyses &PA,
+                  FunctionAnalysisManager::Invalidator &Inv);
+
+private:
+  /**
+   * One demanded fact: the value of an integer SSA name (Value), the value
+   * a store writes (Written), a memory cell on entry to a block (CellIn),
+   * whether the edge from BB to the block V may be taken (Edge), or whether
+   * BB may run at all (Reach). Null means the fact is missing, exactly like
+   * an absent Memory key; for Edge and Reach it means "not (yet) feasible".
+   */
+  struct Node {
+    enum Kind { Value, Written, CellIn, Edge, Reach };
+    Kind K;
+    llvm::Value *V;
+    BasicBlock *BB;
+    unsigned Order;
+    bool Final = false;
+    Domain *State = nullptr;
+    // Facts this one is computed from, -1 for a constant operand.
+    SmallVector<int, 4> Deps;
+    SmallVector<unsigned, 4> Users;
+  };
+  using NodeKey = std::tuple<unsigned, llvm::Value *, BasicBlock *>;
+
+  unsigned demand(Node::Kind K, llvm::Value *V, BasicBlock *BB,
+                  std::vector<unsigned> &New);
+  int demandValue(llvm::Value *Op, Instruction *At, std::vector<unsigned> &New);
+  int demandCell(llvm::Value *P, BasicBlock *BB, BasicBlock::iterator From,
+                 std::vector<unsigned> &New);
+  int demandEdge(BasicBlock *From, BasicBlock *To, std::vector<unsigned> &New);
+  void explore(unsigned Idx, std::vector<unsigned> &New);
+  Domain *evaluate(const Node &N);
+  Domain *solve(Node::Kind K, llvm::Value *V, BasicBlock *BB);
+  const std::vector<llvm::Value *> &aliasesOf(llvm::Value *P);
+  const std::string &name(llvm::Value *V);
+
+  Function &F;
+  PointerAnalysis &PA;
+  SetVector<llvm::Value *> PointerSet;
+  DenseMap<Instruction *, unsigned> Position;
+  std::unique_ptr<InductionInfo> Induction;
+
+  std::vector<Node> Nodes;
+  DenseMap<NodeKey, unsigned> NodeIndex;
+
+  DenseMap<llvm::Value *, std::string> Names;
+  DenseMap<llvm::Value *, std::vector<llvm::Value *>> Aliases;
+};
+
+/**
+ * New pass manager analysis handing out a DivZeroQuery for a function. The
+ * query cache lives as long as the cached result.
+ */
+class DivZeroQueryAnalysis : public AnalysisInfoMixin<DivZeroQueryAnalysis> {
+public:
+  using Result = DivZeroQuery;
+  Result run(Function &F, FunctionAnalysisManager &FAM);
+
+private:
+  friend AnalysisInfoMixin<DivZeroQueryAnalysis>;
+  static AnalysisKey Key;
+};
+} // namespace dataflow
+
+#endif // DIV_ZERO_QUERY_H
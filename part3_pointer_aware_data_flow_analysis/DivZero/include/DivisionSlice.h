@@ -0,0 +1,43 @@
+#ifndef DIVISION_SLICE_H
+#define DIVISION_SLICE_H
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+#include "PointerAnalysis.h"
+
+using namespace llvm;
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Division Slice
+//===----------------------------------------------------------------------===//
+
+/**
+ * Backward slice of a function from the divisors the enabled checkers look
+ * at. The slice follows operands, the stores that may write the cell a load
+ * reads (directly or through an alias), and the aliases a load joins in.
+ * Instructions outside the slice write no Memory key that a divisor's value
+ * depends on, so the solver can treat them as no-ops.
+ */
+class DivisionSlice {
+public:
+  DivisionSlice(Function &F, PointerAnalysis &PA,
+                const SetVector<Value *> &PointerSet, ArrayRef<Value *> Roots);
+
+  /// True if nothing in F is checked, so nothing needs to be solved at all.
+  bool empty() const { return Empty; }
+
+  /// True if I writes a key that some divisor depends on.
+  bool isRelevant(Instruction *I) const { return Relevant.count(I); }
+
+private:
+  bool Empty;
+  DenseSet<Instruction *> Relevant;
+};
+} // namespace dataflow
+
+#endif // DIVISION_SLICE_H
@@ -0,0 +1,38 @@
+#ifndef FEASIBILITY_H
+#define FEASIBILITY_H
+
+#include "llvm/ADT/SmallBitVector.h"
+#include "llvm/IR/Instructions.h"
+
+#include "Domain.h"
+
+using namespace llvm;
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Branch Feasibility
+//===----------------------------------------------------------------------===//
+
+/// True unless -divzero-prune-branches=false.
+bool pruneInfeasibleBranches();
+
+/// The value a conditional branch or switch decides on, null otherwise.
+Value *branchCondition(Instruction *Term);
+
+/**
+ * Set the bits of the successors of Term that can be taken when its
+ * condition has the abstract value Cond. A constant condition is folded
+ * exactly; a null Cond stands for a condition that is not known.
+ */
+void feasibleSuccessors(Instruction *Term, Domain *Cond, SmallBitVector &Taken);
+
+/**
+ * Fold `icmp eq/ne X, 0` when the state of X decides it. A and B are the
+ * states of the two operands. Returns null if the comparison stays unknown
+ * or branch pruning is off.
+ */
+Domain *compareWithZero(CmpInst *Cmp, Domain *A, Domain *B);
+} // namespace dataflow
+
+#endif // FEASIBILITY_H
@@ -0,0 +1,56 @@
+#ifndef INDUCTION_H
+#define INDUCTION_H
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include <memory>
+
+using namespace llvm;
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Induction Variables
+//===----------------------------------------------------------------------===//
+
+/**
+ * Recognises loop induction variables whose value can never be zero, so the
+ * solver can assign NonZero to them directly instead of joining the start
+ * value with the stepped value around the back edge, which only ever gives
+ * MaybeZero in the four-point domain.
+ *
+ * Two shapes are recognised from the loop structure:
+ *  - a local `alloca` cell that is only loaded and stored, where every store
+ *    is a non-zero constant or the cell's own value stepped by a constant
+ *    (`add nsw`/`sub nsw`), at least one step is inside a loop, every step
+ *    reads a value a non-zero constant store dominates, and all constants
+ *    keep the value on the same side of zero;
+ *  - the SSA form of the same thing, a loop-header PHI of a non-zero start
+ *    and its own `add nsw`/`sub nsw` step.
+ * With ScalarEvolution available, any PHI or binary operator in a loop that
+ * is an add recurrence whose signed or unsigned range excludes zero is
+ * recognised as well.
+ */
+class InductionInfo {
+public:
+  InductionInfo(Function &F, ScalarEvolution *SE = nullptr);
+
+  /// Recognise F's induction variables, or return null if -divzero-induction
+  /// is off.
+  static std::unique_ptr<InductionInfo> create(Function &F,
+                                               ScalarEvolution *SE = nullptr);
+
+  /// True if the integer value I defines is never zero when it executes.
+  bool isNeverZero(Instruction *I) const { return NeverZero.count(I); }
+
+private:
+  void addCell(AllocaInst *AI, const DominatorTree &DT, const LoopInfo &LI);
+  void addPHI(PHINode *PN, const LoopInfo &LI);
+
+  DenseSet<Instruction *> NeverZero;
+};
+} // namespace dataflow
+
+#endif // INDUCTION_H
@@ -0,0 +1,45 @@
+#ifndef LIVENESS_H
+#define LIVENESS_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+using namespace llvm;
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Liveness Analysis
+//===----------------------------------------------------------------------===//
+
+/**
+ * Backward liveness of the non-pointer SSA values of a function. Their Memory
+ * key is written once, at the definition, and only read by later uses, so a
+ * forward analysis can drop the key as soon as no use is reachable any more.
+ * Pointer keys stand for memory cells and are read through aliases, so they
+ * are never tracked here.
+ */
+class Liveness {
+public:
+  Liveness(Function &F);
+
+  /**
+   * Values whose key can be dropped from the state right after I executes.
+   * For the first instruction of a block this also covers values that are
+   * still live out of some predecessor but not into this block.
+   */
+  ArrayRef<Instruction *> deadAfter(Instruction *I) const {
+    auto It = DeadAfter.find(I);
+    if (It == DeadAfter.end())
+      return None;
+    return It->second;
+  }
+
+private:
+  DenseMap<Instruction *, SmallVector<Instruction *, 2>> DeadAfter;
+};
+} // namespace dataflow
+
+#endif // LIVENESS_H
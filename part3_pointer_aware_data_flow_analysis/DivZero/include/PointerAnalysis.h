@@ -1,13 +1,27 @@
 #ifndef POINTER_ANALYSIS_H
 #define POINTER_ANALYSIS_H
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/SparseBitVector.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/raw_ostream.h"
 #include <set>
 #include <map>
 #include <string>
+#include <vector>
 
 using namespace llvm;
 
+namespace llvm {
+class ThreadPool;
+} // namespace llvm
+
 namespace dataflow {
 //===----------------------------------------------------------------------===//
 // Pointer Analysis
@@ -15,14 +29,124 @@ namespace dataflow {
 
 using PointsToSet = std::set<std::string>; // a set of memory locations (variables)
 using PointsToInfo = std::map<std::string, PointsToSet>; // map a pointer variable to a set of memory locations
+
+/// True if -divzero-module-pta asks for one points-to analysis per module.
+bool useModulePointerAnalysis();
+
 class PointerAnalysis {
 public:
   PointerAnalysis(Function &F);
   bool alias(std::string &Ptr1, std::string &Ptr2) const;
+  /// Locations Ptr may point to, or null if nothing is known about Ptr.
+  const PointsToSet *pointsTo(const std::string &Ptr) const {
+    auto It = PointsTo.find(Ptr);
+    return It == PointsTo.end() ? nullptr : &It->second;
+  }
+  /// Hash of every points-to set, equal for equal results.
+  hash_code fingerprint() const;
+  void print(raw_ostream &O) const;
 
 private:
+  friend class ModulePointerAnalysis;
+  PointerAnalysis() = default;
+
   PointsToInfo PointsTo;
 };
+
+/**
+ * Inclusion-based (Andersen) points-to analysis of a whole module, solved
+ * once. Arguments take what every caller passes, including through function
+ * pointers, calls take what the callee returns, and globals carry what their
+ * initializers and stores put in them. Every alloca, global, function and
+ * malloc-like call is one location; the fields of a location are not told
+ * apart. Pointers coming from outside the module point nowhere, as in the
+ * per-function analysis. With -divzero-pta-threads other than 1 the
+ * constraints are solved by parallel wave propagation, to the same result.
+ */
+class ModulePointerAnalysis {
+public:
+  explicit ModulePointerAnalysis(Module &M);
+
+  /**
+   * The facts of F's pointer arguments and instructions and of the globals F
+   * uses, keyed like PointerAnalysis(F) so clients cannot tell them apart.
+   */
+  PointerAnalysis getFunctionView(Function &F) const;
+
+  /**
+   * The facts are keyed by the module's values, so they go away unless the
+   * pass that ran preserved them. Function views are dropped along with them
+   * (see PointerAnalysisPass::run).
+   */
+  bool invalidate(Module &M, const PreservedAnalyses &PA,
+                  ModuleAnalysisManager::Invalidator &Inv);
+
+private:
+  struct Node {
+    SparseBitVector<> PointsTo;
+    SparseBitVector<> Handled; // locations loads/stores were expanded for
+    SmallVector<unsigned, 4> Copies;
+    SmallVector<unsigned, 2> Loads;  // n = *this
+    SmallVector<unsigned, 2> Stores; // *this = n
+    SmallVector<CallBase *, 1> Calls; // calls through this pointer
+  };
+
+  int getNode(Value *V);
+  int findNode(Value *V) const;
+  unsigned getLocation(Value *Site);
+  unsigned getReturnNode(Function *F);
+  void addCopy(int From, int To);
+  void addCall(CallBase &CB, Function *Callee);
+  void addInitializer(unsigned Loc, Constant *C);
+  void addConstraints(Instruction &I, const TargetLibraryInfo &TLI);
+  void solve();
+  void solveParallel(unsigned Threads);
+  void propagateWave(ThreadPool &Pool);
+  bool expandConstraints(ThreadPool &Pool);
+  std::string locationName(unsigned Loc) const;
+
+  std::vector<Node> Nodes;
+  SmallVector<unsigned, 64> Worklist;
+  DenseMap<Value *, unsigned> ValueNodes;
+  DenseMap<Function *, unsigned> ReturnNodes;
+  // Location sites, and the node holding what each location contains.
+  std::vector<Value *> Locations;
+  std::vector<unsigned> Contents;
+  DenseMap<Value *, unsigned> LocationIndex;
+  DenseSet<std::pair<unsigned, unsigned>> CopyEdges;
+  DenseSet<std::pair<CallBase *, Function *>> ResolvedCalls;
+};
+
+/**
+ * New pass manager analysis that caches the points-to facts of a function
+ * so every client of the same function shares one PointerAnalysis. With
+ * -divzero-module-pta they are a view of the cached module-wide result, if
+ * one has been computed.
+ */
+class PointerAnalysisPass : public AnalysisInfoMixin<PointerAnalysisPass> {
+public:
+  using Result = PointerAnalysis;
+  Result run(Function &F, FunctionAnalysisManager &FAM);
+
+private:
+  friend AnalysisInfoMixin<PointerAnalysisPass>;
+  static AnalysisKey Key;
+};
+
+/**
+ * Module analysis solving ModulePointerAnalysis. Once it is cached,
+ * PointerAnalysisPass hands out views of it when -divzero-module-pta is set.
+ */
+class ModulePointerAnalysisPass
+    : public AnalysisInfoMixin<ModulePointerAnalysisPass> {
+public:
+  using Result = ModulePointerAnalysis;
+  Result run(Module &M, ModuleAnalysisManager &MAM);
+
+private:
+  friend AnalysisInfoMixin<ModulePointerAnalysisPass>;
+  static AnalysisKey Key;
+};
 }; // namespace dataflow
 
 #endif // POINTER_ANALYSIS_H
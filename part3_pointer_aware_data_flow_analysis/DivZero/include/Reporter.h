@@ -0,0 +1,87 @@
+#ifndef REPORTER_H
+#define REPORTER_H
+
+#include "llvm/IR/Instruction.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <string>
+
+#include "Domain.h"
+
+using namespace llvm;
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Finding Reporter
+//===----------------------------------------------------------------------===//
+
+/// Name of an abstract value as it appears in reports, "Unknown" for null.
+const char *stateName(Domain *State);
+
+/**
+ * Stream for the plain-text report. This is stdout unless the structured
+ * report is written there, in which case the text goes to stderr so that
+ * stdout stays a valid JSON document.
+ */
+raw_ostream &textReportStream();
+
+/**
+ * One reported instruction, located through its debug location. Line and
+ * column are 0 when the instruction carries none.
+ */
+struct Finding {
+  Finding(Instruction *I, Domain *State, StringRef Rule, StringRef Message);
+
+  std::string Rule;
+  std::string Message;
+  std::string File;
+  unsigned Line = 0;
+  unsigned Column = 0;
+  std::string Function;
+  std::string State;
+};
+
+/**
+ * Streams findings as SARIF 2.1.0 or JSON Lines. Every finding is written as
+ * soon as it is reported, so memory use does not grow with the number of
+ * findings; the stream is flushed in fixed-size chunks.
+ */
+class Reporter {
+public:
+  enum Format { SARIF, JSONL };
+
+  Reporter(raw_ostream &OS, Format Fmt, StringRef ToolName);
+  ~Reporter();
+
+  /**
+   * Open the report requested with -divzero-report, or return null if no
+   * report was asked for. Path "-" writes to stdout.
+   */
+  static std::unique_ptr<Reporter> createFromOptions(StringRef ToolName,
+                                                     StringRef DefaultPath = "");
+
+  /**
+   * Use Path when -divzero-report is not given. Set while parsing a pipeline
+   * that contains the report pass, before any pass has printed.
+   */
+  static void setDefaultPath(StringRef Path);
+
+  /// Whether the report requested with -divzero-report goes to stdout.
+  static bool writesToStdout(StringRef DefaultPath = "");
+
+  void report(const Finding &F);
+
+  /// Write the closing part of the document. Called by the destructor.
+  void finish();
+
+private:
+  std::unique_ptr<raw_ostream> Owned;
+  raw_ostream &OS;
+  Format Fmt;
+  unsigned Count = 0;
+  bool Finished = false;
+};
+} // namespace dataflow
+
+#endif // REPORTER_H
@@ -0,0 +1,248 @@
+#include "BlockPatch.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/ModuleSlotTracker.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Block Patching Implementation
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// Printed names and block texts of one function.
+struct PrintedFunction {
+  PrintedFunction(Function &F) : MST(F.getParent()) {
+    MST.incorporateFunction(F);
+    for (BasicBlock &BB : F) {
+      Blocks[name(&BB)] = &BB;
+      for (Instruction &I : BB) {
+        if (!I.getType()->isVoidTy())
+          Values[name(&I)] = &I;
+      }
+    }
+  }
+
+  std::string name(Value *V) {
+    std::string Name;
+    raw_string_ostream OS(Name);
+    V->printAsOperand(OS, false, MST);
+    return OS.str();
+  }
+
+  /**
+   * BB as printed, with metadata numbers left out: they differ between
+   * modules even for the same source. Debug locations are compared by line
+   * and column instead.
+   */
+  std::string text(BasicBlock &BB) {
+    std::string Printed;
+    raw_string_ostream OS(Printed);
+    for (Instruction &I : BB) {
+      I.print(OS, MST);
+      if (const DebugLoc &Loc = I.getDebugLoc())
+        OS << " @" << Loc.getLine() << ":" << Loc.getCol();
+      OS << "\n";
+    }
+    OS.flush();
+
+    std::string Text;
+    for (size_t Pos = 0; Pos < Printed.size(); ++Pos) {
+      Text += Printed[Pos];
+      if (Printed[Pos] != '!')
+        continue;
+      while (Pos + 1 < Printed.size() && isdigit(Printed[Pos + 1]))
+        ++Pos;
+    }
+    return Text;
+  }
+
+  ModuleSlotTracker MST;
+  StringMap<BasicBlock *> Blocks;
+  StringMap<Instruction *> Values;
+};
+} // namespace
+
+/// Value V in a metadata operand, or null if Op does not wrap one.
+static Value *localMetadataValue(Value *Op) {
+  if (auto *MV = dyn_cast<MetadataAsValue>(Op)) {
+    if (auto *Local = dyn_cast<LocalAsMetadata>(MV->getMetadata()))
+      return Local->getValue();
+  }
+  return nullptr;
+}
+
+/// Point the operands and incoming blocks of I at their images in Map.
+static void remap(Instruction &I, const DenseMap<Value *, Value *> &Map) {
+  for (unsigned Idx = 0; Idx < I.getNumOperands(); ++Idx) {
+    Value *Op = I.getOperand(Idx);
+    if (Value *To = Map.lookup(Op)) {
+      I.setOperand(Idx, To);
+    } else if (Value *Local = localMetadataValue(Op)) {
+      if (Value *LocalTo = Map.lookup(Local))
+        I.setOperand(Idx, MetadataAsValue::get(
+                              I.getContext(), LocalAsMetadata::get(LocalTo)));
+    }
+  }
+  if (auto *Phi = dyn_cast<PHINode>(&I)) {
+    for (unsigned Idx = 0; Idx < Phi->getNumIncomingValues(); ++Idx) {
+      if (Value *To = Map.lookup(Phi->getIncomingBlock(Idx)))
+        Phi->setIncomingBlock(Idx, cast<BasicBlock>(To));
+    }
+  }
+}
+
+bool patchChangedBlocks(Function &Old, Function &New,
+                        SmallVectorImpl<BasicBlock *> &Changed) {
+  if (Old.getFunctionType() != New.getFunctionType())
+    return false;
+  for (unsigned Idx = 0; Idx < Old.arg_size(); ++Idx) {
+    if (Old.getArg(Idx)->getName() != New.getArg(Idx)->getName())
+      return false;
+  }
+
+  PrintedFunction OldP(Old), NewP(New);
+  DenseMap<BasicBlock *, std::string> OldNames;
+  DenseMap<Value *, std::string> OldValueNames;
+  for (BasicBlock &BB : Old) {
+    OldNames[&BB] = OldP.name(&BB);
+    for (Instruction &I : BB) {
+      if (!I.getType()->isVoidTy())
+        OldValueNames[&I] = OldP.name(&I);
+    }
+  }
+
+  // Pair the blocks that print the same.
+  DenseMap<BasicBlock *, BasicBlock *> Kept; // old -> new
+  for (BasicBlock &NBB : New) {
+    BasicBlock *OBB = OldP.Blocks.lookup(NewP.name(&NBB));
+    if (OBB && OldP.text(*OBB) == NewP.text(NBB))
+      Kept[OBB] = &NBB;
+  }
+
+  // The value New has under the name of I, or null if there is none of the
+  // same type.
+  auto Counterpart = [&](Instruction *I) -> Instruction * {
+    Instruction *NI = NewP.Values.lookup(OldValueNames[I]);
+    return NI && NI->getType() == I->getType() ? NI : nullptr;
+  };
+
+  // A kept block may only refer to dropped old values and blocks that New
+  // has under the same name, so they can be redirected; unpair the rest.
+  auto Resolvable = [&](Value *V) {
+    if (auto *BB = dyn_cast_or_null<BasicBlock>(V))
+      return Kept.count(BB) || NewP.Blocks.count(OldNames[BB]);
+    auto *I = dyn_cast_or_null<Instruction>(V);
+    return !I || Kept.count(I->getParent()) || Counterpart(I);
+  };
+  for (bool Again = true; Again;) {
+    Again = false;
+    for (BasicBlock &OBB : Old) {
+      if (!Kept.count(&OBB))
+        continue;
+      bool Ok = true;
+      for (Instruction &I : OBB) {
+        for (Value *Op : I.operands())
+          Ok &= Resolvable(Op) && Resolvable(localMetadataValue(Op));
+        if (auto *Phi = dyn_cast<PHINode>(&I)) {
+          for (BasicBlock *In : Phi->blocks())
+            Ok &= Resolvable(In);
+        }
+      }
+      if (!Ok) {
+        Kept.erase(&OBB);
+        Again = true;
+      }
+    }
+  }
+
+  // New values and blocks of kept pairs stand for the old ones.
+  DenseMap<Value *, Value *> Map;
+  for (unsigned Idx = 0; Idx < Old.arg_size(); ++Idx)
+    Map[New.getArg(Idx)] = Old.getArg(Idx);
+  for (auto &Pair : Kept) {
+    Map[Pair.second] = Pair.first;
+    for (auto It : zip(*Pair.first, *Pair.second)) {
+      Instruction &OI = std::get<0>(It), &NI = std::get<1>(It);
+      Map[&NI] = &OI;
+      OI.copyMetadata(NI);
+      for (unsigned Idx = 0; Idx < OI.getNumOperands(); ++Idx) {
+        Value *Op = NI.getOperand(Idx);
+        if (isa<MetadataAsValue>(Op) && !localMetadataValue(Op))
+          OI.setOperand(Idx, Op);
+      }
+    }
+  }
+
+  // Blocks in New's order, and the kept blocks a dropped one led to.
+  std::vector<BasicBlock *> Order;
+  for (BasicBlock &NBB : New)
+    Order.push_back(&NBB);
+  std::vector<BasicBlock *> Dropped;
+  SmallPtrSet<BasicBlock *, 8> LostPred;
+  for (BasicBlock &OBB : Old) {
+    if (Kept.count(&OBB))
+      continue;
+    Dropped.push_back(&OBB);
+    for (BasicBlock *Succ : successors(&OBB)) {
+      if (Kept.count(Succ))
+        LostPred.insert(Succ);
+    }
+  }
+
+  // Kept blocks take the same-named new values of dropped blocks.
+  auto Image = [&](Value *V) -> Value * {
+    Value *To = Map.lookup(V);
+    return To ? To : V;
+  };
+  for (BasicBlock *OBB : Dropped) {
+    for (Instruction &I : *OBB) {
+      if (I.use_empty() || I.getType()->isVoidTy())
+        continue;
+      if (Instruction *NI = Counterpart(&I))
+        I.replaceAllUsesWith(Image(NI));
+    }
+    if (BasicBlock *NBB = NewP.Blocks.lookup(OldNames[OBB]))
+      OBB->replaceAllUsesWith(Image(NBB));
+  }
+
+  // Erased first so that the moved values keep their names.
+  for (BasicBlock *OBB : Dropped)
+    OBB->dropAllReferences();
+  for (BasicBlock *OBB : Dropped)
+    OBB->eraseFromParent();
+
+  for (BasicBlock *NBB : Order) {
+    if (Map.count(NBB))
+      continue;
+    NBB->removeFromParent();
+    NBB->insertInto(&Old);
+    for (Instruction &I : *NBB)
+      remap(I, Map);
+    Changed.push_back(NBB);
+  }
+  for (BasicBlock *BB : LostPred)
+    Changed.push_back(BB);
+
+  for (BasicBlock *&BB : Order)
+    BB = cast<BasicBlock>(Image(BB));
+  for (size_t Idx = 0; Idx < Order.size(); ++Idx) {
+    if (Idx == 0)
+      Order[Idx]->moveBefore(&Old.front());
+    else
+      Order[Idx]->moveAfter(Order[Idx - 1]);
+  }
+
+  Old.setAttributes(New.getAttributes());
+  if (DISubprogram *SP = New.getSubprogram())
+    Old.setSubprogram(SP);
+  New.dropAllReferences();
+  return true;
+}
+} // namespace dataflow
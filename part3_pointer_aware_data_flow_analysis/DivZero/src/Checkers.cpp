@@ -0,0 +1,76 @@
+#include "Checker.h"
+
+#include "llvm/Support/CommandLine.h"
+
+LLVM_INSTANTIATE_REGISTRY(dataflow::CheckerRegistry)
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Built-in Checkers
+//===----------------------------------------------------------------------===//
+
+static cl::list<std::string>
+    EnabledCheckers("divzero-checkers", cl::CommaSeparated,
+                    cl::desc("Checkers run on the solved states "
+                             "(default: divzero)"),
+                    cl::value_desc("name,..."));
+
+static Value *divisorOf(Instruction *I, unsigned Opcode1, unsigned Opcode2) {
+  BinaryOperator *BO = dyn_cast<BinaryOperator>(I);
+  if (!BO || (BO->getOpcode() != Opcode1 && BO->getOpcode() != Opcode2))
+    return nullptr;
+  return BO->getOperand(1);
+}
+
+namespace {
+/// Integer division whose divisor may be zero.
+class DivZeroChecker : public Checker {
+public:
+  StringRef getName() const override { return "DivZero"; }
+  StringRef getMessage() const override { return "Divisor may be zero"; }
+  Value *getCheckedValue(Instruction *I) const override {
+    return divisorOf(I, Instruction::SDiv, Instruction::UDiv);
+  }
+};
+
+/// Integer remainder whose divisor may be zero.
+class RemZeroChecker : public Checker {
+public:
+  StringRef getName() const override { return "RemZero"; }
+  StringRef getMessage() const override {
+    return "Remainder divisor may be zero";
+  }
+  Value *getCheckedValue(Instruction *I) const override {
+    return divisorOf(I, Instruction::SRem, Instruction::URem);
+  }
+};
+} // namespace
+
+static CheckerRegistry::Add<DivZeroChecker>
+    DivZero("divzero", "Division by a value that may be zero");
+static CheckerRegistry::Add<RemZeroChecker>
+    RemZero("remzero", "Remainder by a value that may be zero");
+
+std::vector<std::unique_ptr<Checker>> createEnabledCheckers() {
+  std::vector<std::string> Names(EnabledCheckers.begin(),
+                                 EnabledCheckers.end());
+  if (Names.empty())
+    Names.push_back("divzero");
+
+  std::vector<std::unique_ptr<Checker>> Checkers;
+  for (const std::string &Name : Names) {
+    bool Found = false;
+    for (const CheckerRegistry::entry &Entry : CheckerRegistry::entries()) {
+      if (Entry.getName() == Name) {
+        Checkers.push_back(Entry.instantiate());
+        Found = true;
+        break;
+      }
+    }
+    if (!Found)
+      errs() << "warning: unknown checker '" << Name << "'\n";
+  }
+  return Checkers;
+}
+} // namespace dataflow
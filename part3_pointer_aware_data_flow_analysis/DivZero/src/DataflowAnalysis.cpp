@@ -1,5 +1,10 @@
 #include "DataflowAnalysis.h"
 
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ThreadPool.h"
+#include <atomic>
+
 using namespace llvm;
 
 namespace dataflow {
@@ -31,7 +36,11 @@ std::string address(Value *V) {
 // Dataflow Analysis Implementation
 //===----------------------------------------------------------------------===//
 
-DataflowAnalysis::DataflowAnalysis(char ID) : FunctionPass(ID) {}
+DataflowAnalysis::DataflowAnalysis(char ID)
+    : FunctionPass(ID), InMap(StateMapConfig::ExtraData{&InMap}),
+      OutMap(StateMapConfig::ExtraData{&OutMap}) {}
+
+DataflowAnalysis::~DataflowAnalysis() { releaseMemory(); }
 
 void DataflowAnalysis::collectErrorInsts(Function &F) {
   for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
@@ -40,26 +49,196 @@ void DataflowAnalysis::collectErrorInsts(Function &F) {
   }
 }
 
-bool DataflowAnalysis::runOnFunction(Function &F) {
-  outs() << "Running " << getAnalysisName() << " on " << F.getName() << "\n";
+void DataflowAnalysis::analyze(Function &F, PointerAnalysis *PA,
+                               ScalarEvolution *SE) {
+  releaseMemory();
+  this->SE = SE;
   for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
     InMap[&(*I)] = new Memory;
     OutMap[&(*I)] = new Memory;
   }
 
-  PointerAnalysis *PA = new PointerAnalysis(F);
   doAnalysis(F, PA);
+  this->SE = nullptr;
+  collectErrorInsts(F);
+}
+
+void DataflowAnalysis::reanalyze(Function &F, PointerAnalysis *PA,
+                                 ArrayRef<BasicBlock *> Changed,
+                                 ScalarEvolution *SE) {
+  this->SE = SE;
+  Incremental = true;
+  for (BasicBlock *BB : Changed)
+    markChanged(BB);
 
+  doAnalysis(F, PA);
+  Incremental = false;
+  Affected.clear();
+  this->SE = nullptr;
+
+  // Findings are cheap to collect again, and some may have been erased.
+  ErrorInsts.clear();
   collectErrorInsts(F);
-  outs() << "Potential Instructions by " << getAnalysisName() << ": \n";
-  for (auto I : ErrorInsts) {
-    outs() << *I << "\n";
+}
+
+void DataflowAnalysis::markChanged(BasicBlock *BB) {
+  SmallVector<BasicBlock *, 16> Stack(1, BB);
+  while (!Stack.empty()) {
+    BasicBlock *Cur = Stack.pop_back_val();
+    if (!Affected.insert(Cur).second)
+      continue;
+    for (Instruction &I : *Cur) {
+      Memory *&In = InMap[&I];
+      delete In;
+      In = new Memory;
+      Memory *&Out = OutMap[&I];
+      delete Out;
+      Out = new Memory;
+    }
+    for (BasicBlock *Succ : successors(Cur))
+      Stack.push_back(Succ);
   }
+}
 
-  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
-    delete InMap[&(*I)];
-    delete OutMap[&(*I)];
+void DataflowAnalysis::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<ScalarEvolutionWrapperPass>();
+  AU.setPreservesAll();
+}
+
+bool DataflowAnalysis::doInitialization(Module &M) {
+  Report = Reporter::createFromOptions(getAnalysisName());
+  if (useModulePointerAnalysis())
+    ModulePTA.reset(new ModulePointerAnalysis(M));
+  return false;
+}
+
+bool DataflowAnalysis::runOnFunction(Function &F) {
+  raw_ostream &OS = textReportStream();
+  OS << "Running " << getAnalysisName() << " on " << F.getName() << "\n";
+
+  PointerAnalysis PA =
+      ModulePTA ? ModulePTA->getFunctionView(F) : PointerAnalysis(F);
+  PA.print(errs());
+  analyze(F, &PA, &getAnalysis<ScalarEvolutionWrapperPass>().getSE());
+
+  OS << "Potential Instructions by " << getAnalysisName() << ": \n";
+  for (auto I : ErrorInsts) {
+    OS << *I << "\n";
   }
+  if (Report) {
+    for (auto I : ErrorInsts)
+      Report->report(Finding(I, getFindingState(I), getFindingRule(I),
+                             getFindingMessage(I)));
+  }
+
+  releaseMemory();
+  return false;
+}
+
+bool DataflowAnalysis::doFinalization(Module &M) {
+  Report.reset();
+  ModulePTA.reset();
   return false;
 }
+
+//===----------------------------------------------------------------------===//
+// Worklist Solver
+//===----------------------------------------------------------------------===//
+
+static cl::opt<unsigned> SolverThreads(
+    "divzero-threads", cl::init(1),
+    cl::desc("Threads solving independent CFG regions of one function "
+             "(0 = all hardware threads, 1 = serial)"));
+
+void DataflowAnalysis::solve(
+    Function &F,
+    function_ref<void(Instruction *, SetVector<Instruction *> &)> Step) {
+  std::vector<std::vector<BasicBlock *>> Regions;
+  DenseMap<BasicBlock *, unsigned> RegionOf;
+  if (SolverThreads != 1 && !Incremental) {
+    // scc_iterator hands out the SCCs in reverse topological order.
+    for (scc_iterator<Function *> It = scc_begin(&F); !It.isAtEnd(); ++It) {
+      for (BasicBlock *BB : *It)
+        RegionOf[BB] = Regions.size();
+      Regions.push_back(*It);
+    }
+  }
+
+  // Regions only cover the blocks reachable from the entry. Anything else,
+  // functions with a single region and re-solves take the serial path.
+  if (Incremental || Regions.size() < 2 || RegionOf.size() != F.size()) {
+    SetVector<Instruction *> WorkSet;
+    for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+      if (!Incremental || Affected.count(I->getParent()))
+        WorkSet.insert(&(*I));
+    }
+    while (!WorkSet.empty()) {
+      Instruction *I = *WorkSet.begin();
+      WorkSet.remove(I);
+      Step(I, WorkSet);
+    }
+    return;
+  }
+
+  // Number of regions each region still waits for.
+  std::unique_ptr<std::atomic<unsigned>[]> Pending(
+      new std::atomic<unsigned>[Regions.size()]);
+  std::vector<SmallVector<unsigned, 4>> Succs(Regions.size());
+  for (unsigned R = 0; R < Regions.size(); ++R) {
+    SmallVector<unsigned, 4> Preds;
+    for (BasicBlock *BB : Regions[R]) {
+      for (BasicBlock *Pred : predecessors(BB)) {
+        unsigned P = RegionOf[Pred];
+        if (P != R && !is_contained(Preds, P))
+          Preds.push_back(P);
+      }
+    }
+    Pending[R] = Preds.size();
+    for (unsigned P : Preds)
+      Succs[P].push_back(R);
+  }
+
+  ThreadPool Pool(hardware_concurrency(SolverThreads));
+  std::function<void(unsigned)> SolveRegion = [&](unsigned R) {
+    // The region's worklist belongs to this task alone, seeded in program
+    // order like the serial solver.
+    SmallPtrSet<BasicBlock *, 8> Blocks(Regions[R].begin(), Regions[R].end());
+    SetVector<Instruction *> WorkSet;
+    for (BasicBlock &BB : F) {
+      if (!Blocks.count(&BB))
+        continue;
+      for (Instruction &I : BB)
+        WorkSet.insert(&I);
+    }
+    while (!WorkSet.empty()) {
+      Instruction *I = *WorkSet.begin();
+      WorkSet.remove(I);
+      // Successor regions read the final state once this one is done.
+      if (!Blocks.count(I->getParent()))
+        continue;
+      Step(I, WorkSet);
+    }
+
+    for (unsigned S : Succs[R]) {
+      if (--Pending[S] == 0)
+        Pool.async([&SolveRegion, S] { SolveRegion(S); });
+    }
+  };
+
+  for (unsigned R = 0; R < Regions.size(); ++R) {
+    if (Pending[R] == 0)
+      Pool.async([&SolveRegion, R] { SolveRegion(R); });
+  }
+  Pool.wait();
+}
+
+void DataflowAnalysis::releaseMemory() {
+  for (auto Entry : InMap)
+    delete Entry.second;
+  for (auto Entry : OutMap)
+    delete Entry.second;
+  InMap.clear();
+  OutMap.clear();
+  ErrorInsts.clear();
+}
 } // namespace dataflow
@@ -1,4 +1,13 @@
 #include "DivZeroAnalysis.h"
+#include "DivZeroQuery.h"
+#include "DivisionSlice.h"
+#include "Feasibility.h"
+#include "Induction.h"
+#include "Liveness.h"
+
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
 
 namespace dataflow {
 
@@ -19,6 +28,16 @@ static Domain Z(Domain::Zero);        // Zero
 static Domain NZ(Domain::NonZero);    // Non Zero
 static Domain U(Domain::Uninit);      // Uninitialized
 
+static cl::opt<bool> PruneDead(
+    "divzero-prune-dead", cl::init(true),
+    cl::desc("Drop integer temporaries from the abstract state once they "
+             "are no longer live"));
+
+static cl::opt<bool> SliceDivisions(
+    "divzero-slice", cl::init(true),
+    cl::desc("Only run the transfer function on instructions that some "
+             "divisor depends on"));
+
 // define the following functions if needed (not compulsory to do so)
 /* example:
   M1 = {"%x" → NonZero, "%y" → Zero}
@@ -76,10 +95,14 @@ void DivZeroAnalysis::flowIn(Instruction *I, Memory *In) {
   std::vector<Instruction *> preds = getPredecessors(I); // get predecessors of I
 
   // get all the predecessors' of I in the block
+  bool isLeader = I == &I->getParent()->front();
   for(Instruction *P : preds){
+    // an edge whose branch condition never holds brings nothing in
+    if(isLeader && !isFeasibleEdge(P->getParent(), I->getParent())) continue;
     //OutMap[P] = current instruction P -> Memory* { "variable" → abstract value }
     //*POut = Memory* { "variable" → abstract value }
-    Memory *POut = OutMap[P]; // get the out memory of the predecessor.
+    auto POutIt = OutMap.find(P); // get the out memory of the predecessor.
+    Memory *POut = POutIt != OutMap.end() ? POutIt->second : nullptr;
     if(!POut) continue; // if null, skip
     Memory *NewIn = join(InUnion, POut); // join the current InUnion with the predecessor's out memory
     delete InUnion; // free the memory
@@ -140,6 +163,10 @@ void DivZeroAnalysis::transfer(Instruction *I, const Memory *In, Memory *NOut,
         abstVal = &MZ;
       break;
     }
+    // a step of an induction variable that never reaches zero: jump straight
+    // to NonZero instead of iterating the loop
+    if(Induction && Induction->isNeverZero(I))
+      abstVal = &NZ;
     (*NOut)[inst] = abstVal;
   //------------------[CAST INSTRUCTION]------------------------//
   } else if (CastInst *CAI = dyn_cast<CastInst>(I)){
@@ -211,12 +238,46 @@ void DivZeroAnalysis::transfer(Instruction *I, const Memory *In, Memory *NOut,
         }
         (*NOut)[inst] = isTrue ? &NZ: &Z;
       }else
-        (*NOut)[inst] = &MZ; // a is constant, b is not constant
+        {
+        // a is constant, b is not constant
+        auto it = In->find(variable(b));
+        Domain *folded = compareWithZero(CMI, &NZ, it != In->end() ? it->second : &MZ);
+        (*NOut)[inst] = folded ? folded : &MZ;
+      }
     } else if(ConstantInt *CB = dyn_cast<ConstantInt>(b)){
-      (*NOut)[inst] = &MZ; // b is constant, a is not constant
+      // b is constant, a is not constant: x == 0 and x != 0 are still known
+      // when x is
+      auto it = In->find(variable(a));
+      Domain *folded = compareWithZero(CMI, it != In->end() ? it->second : &MZ, &NZ);
+      (*NOut)[inst] = folded ? folded : &MZ;
     } else
       (*NOut)[inst] = &MZ; // both are not constants, we cannot determine the abstract value of the return value
 
+  //------------------[PHI NODE]------------------------//
+  } else if (PHINode *PN = dyn_cast<PHINode>(I)){
+    // an SSA value has the same abstract value on every path, so a phi is the
+    // join of its incoming values
+    if(PN->getType()->isIntegerTy()){
+      Domain *abstVal = nullptr;
+      for(unsigned i = 0; i < PN->getNumIncomingValues(); i++){
+        // values coming in over an edge that is never taken do not count
+        if(!isFeasibleEdge(PN->getIncomingBlock(i), PN->getParent())) continue;
+        Value *V = PN->getIncomingValue(i);
+        Domain *inVal = &MZ;
+        if(ConstantInt *CI = dyn_cast<ConstantInt>(V)){
+          inVal = CI->isZero() ? &Z : &NZ;
+        } else{
+          auto it = In->find(variable(V));
+          if(it != In->end())
+            inVal = it->second;
+        }
+        abstVal = abstVal ? Domain::join(abstVal, inVal) : inVal;
+      }
+      if(Induction && Induction->isNeverZero(PN))
+        abstVal = &NZ;
+      (*NOut)[inst] = abstVal ? abstVal : &MZ;
+    }
+
   //------------------[BRANCH INSTRUCTION]------------------------//
   } else if (BranchInst *BI = dyn_cast<BranchInst>(I)){
     //do nothing 
@@ -332,7 +393,8 @@ void DivZeroAnalysis::flowOut(Instruction *I, Memory *Pre, Memory *Post,  SetVec
   // first check if the memory state has changed after the transfer function
   if(!equal(Pre,Post)){
     // if changed, we need to reanalyze all the successors of I
-    OutMap[I] = Post; // update the OutMap with the new state
+    OutMap.find(I)->second = Post; // update the OutMap with the new state
+    delete Pre;
 
     std::vector<Instruction *> succs = getSuccessors(I);
     for(Instruction *S : succs){
@@ -340,19 +402,16 @@ void DivZeroAnalysis::flowOut(Instruction *I, Memory *Pre, Memory *Post,  SetVec
     }
     }else{
       // if not changed, just update OutMap
-      OutMap[I] = Post;
+      OutMap.find(I)->second = Post;
+      delete Pre;
     }
 }
 
 void DivZeroAnalysis::doAnalysis(Function &F, PointerAnalysis *PA) {
   SetVector<Value *> PointerSet;
-  SetVector<Instruction *> WorkSet;
+  FindingCheckers.clear(); // check() runs again once solved
 
   for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
-    InMap[&(*I)] = new Memory();
-    OutMap[&(*I)] = new Memory();
-
-    WorkSet.insert(&(*I));
     //only if instruction is a pointer, add to pointer set
     if(I->getType()->isPointerTy())
       PointerSet.insert(&(*I));
@@ -368,60 +427,387 @@ void DivZeroAnalysis::doAnalysis(Function &F, PointerAnalysis *PA) {
   */ 
    //chaotic iteration algorithm
 
+  // Values the enabled checkers look at. Without any there is nothing to
+  // solve, so no state from before may survive either.
+  std::vector<Value *> Roots;
+  if (SliceDivisions) {
+    for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+      for (auto &C : Checkers) {
+        if (Value *V = C->getCheckedValue(&*I))
+          Roots.push_back(V);
+      }
+    }
+    if (Roots.empty() && Incremental) {
+      for (BasicBlock &BB : F)
+        markChanged(&BB);
+    }
+  }
+
+  // on a re-solve the entry state only needs seeding if it was reset
+  bool seedArgs = !Incremental || Affected.count(&F.getEntryBlock());
   for (Argument &arg : F.args()){
     std::string argVar = variable(&arg);
     Instruction *firstInst = &*(inst_begin(F));
     if(arg.getType()->isIntegerTy()){
       // if the argument is an integer, we initialize it to MaybeZero
-      (*InMap[firstInst])[argVar] = &MZ;
+      if(seedArgs) (*InMap[firstInst])[argVar] = &MZ;
     } else if(arg.getType()->isPointerTy()){
       // if the argument is a pointer, we initialize it to MaybeZero as well
       PointerSet.insert(&arg); // add the argument to the pointer set as well
-      (*InMap[firstInst])[argVar] = &NZ; // we assume that the pointer argument is non-zero 
+      if(seedArgs) (*InMap[firstInst])[argVar] = &NZ; // we assume that the pointer argument is non-zero 
     }
   }
-  while(!WorkSet.empty()){
-    Instruction *I = *WorkSet.begin();
-    WorkSet.remove(I);
 
-    Memory *In = InMap[I];
-    Memory *OldOut = OutMap[I];
+  // Skip functions where no checker has anything to look at, and treat
+  // everything outside the checked values' slice as a no-op.
+  std::unique_ptr<DivisionSlice> NewSlice;
+  if (SliceDivisions) {
+    if (Roots.empty()) {
+      FeasibleSuccs.clear();
+      Slice.reset();
+      DeadKeys.clear();
+      Induction.reset();
+      Solved = false;
+      return;
+    }
+    // Branch conditions decide which blocks run, so they are needed too.
+    if (pruneInfeasibleBranches()) {
+      for (BasicBlock &BB : F) {
+        Value *Cond = branchCondition(BB.getTerminator());
+        if (Cond && !isa<Constant>(Cond))
+          Roots.push_back(Cond);
+      }
+    }
+    NewSlice.reset(new DivisionSlice(F, *PA, PointerSet, Roots));
+  }
+
+  std::unique_ptr<InductionInfo> NewInduction = InductionInfo::create(F, SE);
+
+  // Keys to erase from the Out state of each instruction. A dead key is
+  // never read again, so dropping it keeps states small without changing
+  // any value that check() looks at.
+  DenseMap<Instruction *, std::vector<std::string>> NewDeadKeys;
+  if (PruneDead) {
+    Liveness LV(F);
+    DenseMap<Instruction *, std::string> Names;
+    for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+      for (Instruction *D : LV.deadAfter(&*I)) {
+        std::string &Name = Names[D];
+        if (Name.empty())
+          Name = variable(D);
+        NewDeadKeys[&*I].push_back(Name);
+      }
+    }
+  }
+
+  // State keys are printed IR, and an edit may renumber unnamed values.
+  std::vector<std::string> NewPointerKeys;
+  for (Value *P : PointerSet)
+    NewPointerKeys.push_back(variable(P));
+  DenseMap<Instruction *, std::string> NewValueKeys;
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    if (I->getType()->isIntegerTy())
+      NewValueKeys[&*I] = variable(&*I);
+  }
+
+  // An edit can make code elsewhere matter to a divisor, keep a temporary
+  // alive longer, change an induction variable or rename an integer, so
+  // unchanged blocks whose instructions are affected that way are solved
+  // again too. Any store may write any pointer's key, so if the pointers
+  // or what they point to changed nothing is kept.
+  hash_code NewSolvedPA = PA->fingerprint();
+  if (Incremental) {
+    bool KeepNone = !Solved || NewPointerKeys != PointerKeys ||
+                    NewSolvedPA != SolvedPA;
+    for (BasicBlock &BB : F) {
+      if (Affected.count(&BB))
+        continue;
+      for (Instruction &I : BB) {
+        auto Key = ValueKeys.find(&I);
+        bool Renamed = I.getType()->isIntegerTy() &&
+                       (Key == ValueKeys.end() ||
+                        Key->second != NewValueKeys[&I]);
+        if (KeepNone || Renamed ||
+            factsChanged(&I, NewSlice.get(), NewDeadKeys, NewInduction.get())) {
+          markChanged(&BB);
+          break;
+        }
+      }
+    }
+  }
+  Slice = std::move(NewSlice);
+  DeadKeys = std::move(NewDeadKeys);
+  Induction = std::move(NewInduction);
+  SolvedPA = NewSolvedPA;
+  PointerKeys = std::move(NewPointerKeys);
+  ValueKeys = std::move(NewValueKeys);
+  Solved = true;
+
+  // Every terminator gets its entry up front so that concurrent regions
+  // never insert into the map. Edges out of unaffected blocks keep what was
+  // found for them.
+  DenseMap<Instruction *, SmallBitVector> OldFeasibleSuccs;
+  OldFeasibleSuccs.swap(FeasibleSuccs);
+  if (pruneInfeasibleBranches()) {
+    for (BasicBlock &BB : F) {
+      Instruction *Term = BB.getTerminator();
+      auto Old = OldFeasibleSuccs.find(Term);
+      if (Incremental && !Affected.count(&BB) && Old != OldFeasibleSuccs.end())
+        FeasibleSuccs[Term] = Old->second;
+      else
+        FeasibleSuccs[Term].resize(Term->getNumSuccessors());
+    }
+  }
+
+  solve(F, [&](Instruction *I, SetVector<Instruction *> &WorkSet) {
+    // Blocks are only visited once an edge into them is found feasible.
+    if (!isExecutable(I->getParent()))
+      return;
+    Memory *In = InMap.find(I)->second;
+    Memory *OldOut = OutMap.find(I)->second;
     Memory *NewOut = new Memory();
 
     flowIn(I, In);
-    transfer(I, In, NewOut, PA, PointerSet);
+    if (!Slice || Slice->isRelevant(I))
+      transfer(I, In, NewOut, PA, PointerSet);
+    else
+      *NewOut = *In;
+    auto Dead = DeadKeys.find(I);
+    if (Dead != DeadKeys.end()) {
+      for (const std::string &Key : Dead->second)
+        NewOut->erase(Key);
+    }
     flowOut(I, OldOut, NewOut, WorkSet);
+    if (I->isTerminator())
+      markFeasibleSuccessors(I, In, WorkSet);
+  });
+}
+
+bool DivZeroAnalysis::factsChanged(
+    Instruction *I, const DivisionSlice *NewSlice,
+    const DenseMap<Instruction *, std::vector<std::string>> &NewDeadKeys,
+    const InductionInfo *NewInduction) {
+  bool WasRelevant = !Slice || Slice->isRelevant(I);
+  bool IsRelevant = !NewSlice || NewSlice->isRelevant(I);
+  if (WasRelevant != IsRelevant)
+    return true;
+
+  bool WasNeverZero = Induction && Induction->isNeverZero(I);
+  bool IsNeverZero = NewInduction && NewInduction->isNeverZero(I);
+  if (WasNeverZero != IsNeverZero)
+    return true;
+
+  auto Old = DeadKeys.find(I);
+  auto New = NewDeadKeys.find(I);
+  if (Old == DeadKeys.end() || New == NewDeadKeys.end())
+    return (Old == DeadKeys.end()) != (New == NewDeadKeys.end());
+  return Old->second != New->second;
+}
+
+bool DivZeroAnalysis::isFeasibleEdge(BasicBlock *From, BasicBlock *To) {
+  auto It = FeasibleSuccs.find(From->getTerminator());
+  if (It == FeasibleSuccs.end())
+    return true;
+  Instruction *Term = From->getTerminator();
+  for (unsigned Idx : It->second.set_bits()) {
+    if (Term->getSuccessor(Idx) == To)
+      return true;
   }
+  return false;
 }
 
-bool DivZeroAnalysis::check(Instruction *I) {
-  if (BinaryOperator *BO = dyn_cast<BinaryOperator>(I)){
-    if(BO->getOpcode() == Instruction::SDiv || BO->getOpcode() == Instruction::UDiv){
-      Memory *In = InMap[I]; //get the abstract state just before running the instruction
-      if(!In) return false;
-      Value *denominator = BO->getOperand(1);
+bool DivZeroAnalysis::isExecutable(BasicBlock *BB) {
+  if (FeasibleSuccs.empty() || BB->isEntryBlock())
+    return true;
+  for (BasicBlock *Pred : predecessors(BB)) {
+    if (isFeasibleEdge(Pred, BB))
+      return true;
+  }
+  return false;
+}
 
-      if(ConstantInt *CI = dyn_cast<ConstantInt>(denominator))
-        return CI->isZero(); // if constant, check if its zero 
-      
-      // non constant, we look up in the In memory 
-      std::string div_var = variable(denominator);
-      Domain *abstVal = &MZ; // fallback
-      auto it = In->find(div_var); // look for the variable in the In memory
-      if(it != In->end()) // if iterator found the value
-        abstVal = it->second; // get the abstract value
+void DivZeroAnalysis::markFeasibleSuccessors(Instruction *Term,
+                                             const Memory *In,
+                                             SetVector<Instruction *> &WorkSet) {
+  auto It = FeasibleSuccs.find(Term);
+  if (It == FeasibleSuccs.end())
+    return;
+  Domain *Cond = nullptr;
+  if (Value *C = branchCondition(Term)) {
+    auto CondIt = In->find(variable(C));
+    if (CondIt != In->end())
+      Cond = CondIt->second;
+  }
+  SmallBitVector Taken;
+  feasibleSuccessors(Term, Cond, Taken);
+
+  // Edges only ever become feasible. The whole target block is queued
+  // since it may have been skipped while it was not executable.
+  for (unsigned Idx : Taken.set_bits()) {
+    if (It->second.test(Idx))
+      continue;
+    It->second.set(Idx);
+    for (Instruction &I : *Term->getSuccessor(Idx))
+      WorkSet.insert(&I);
+  }
+}
 
-      if(abstVal->Value == Domain::Zero || abstVal->Value == Domain::MaybeZero || abstVal->Value == Domain::Uninit)
-        return true; // potential divide by zero
-      
-      return false; // not a divide by zero
+Domain *DivZeroAnalysis::getStateBefore(Instruction *I, Value *V) {
+  if (ConstantInt *CI = dyn_cast<ConstantInt>(V))
+    return CI->isZero() ? &Z : &NZ; // constants need no lookup
+  auto InIt = InMap.find(I); // the abstract state just before running I
+  if (InIt == InMap.end())
+    return nullptr;
+  auto It = InIt->second->find(variable(V));
+  return It != InIt->second->end() ? It->second : &MZ; // fallback
+}
+
+bool DivZeroAnalysis::check(Instruction *I) {
+  // Code that never runs cannot divide by zero.
+  if (!isExecutable(I->getParent()))
+    return false;
+  // Every enabled checker reads the same solved state; the first one that
+  // flags I reports it.
+  for (auto &C : Checkers) {
+    Value *V = C->getCheckedValue(I);
+    if (!V)
+      continue;
+    Domain *State = getStateBefore(I, V);
+    if (State && C->check(I, State)) {
+      FindingCheckers[I] = C.get();
+      return true;
     }
-    return false; // not a div instruction
   }
-  return false; // not a binary operator
+  return false;
+}
+
+Domain *DivZeroAnalysis::getFindingState(Instruction *I) {
+  for (auto &C : Checkers) {
+    if (Value *V = C->getCheckedValue(I))
+      return getStateBefore(I, V);
+  }
+  return nullptr;
+}
+
+std::string DivZeroAnalysis::getFindingRule(Instruction *I) {
+  auto It = FindingCheckers.find(I);
+  if (It == FindingCheckers.end())
+    return getAnalysisName();
+  return It->second->getName().str();
+}
+
+std::string DivZeroAnalysis::getFindingMessage(Instruction *I) {
+  auto It = FindingCheckers.find(I);
+  if (It == FindingCheckers.end())
+    return DataflowAnalysis::getFindingMessage(I);
+  return It->second->getMessage().str();
+}
+
+void DivZeroAnalysis::releaseMemory() {
+  FindingCheckers.clear();
+  FeasibleSuccs.clear();
+  Slice.reset();
+  DeadKeys.clear();
+  Induction.reset();
+  PointerKeys.clear();
+  ValueKeys.clear();
+  Solved = false;
+  DataflowAnalysis::releaseMemory();
 }
 
 char DivZeroAnalysis::ID = 1;
 static RegisterPass<DivZeroAnalysis> X("DivZero", "Divide-by-zero Analysis",
                                        false, false);
+
+//===----------------------------------------------------------------------===//
+// New Pass Manager Integration
+//===----------------------------------------------------------------------===//
+
+AnalysisKey DivZeroAnalysisPass::Key;
+
+DivZeroAnalysisPass::Result
+DivZeroAnalysisPass::run(Function &F, FunctionAnalysisManager &FAM) {
+  PointerAnalysis &PA = FAM.getResult<PointerAnalysisPass>(F);
+  std::unique_ptr<DivZeroAnalysis> DZ(new DivZeroAnalysis());
+  DZ->analyze(F, &PA, &FAM.getResult<ScalarEvolutionAnalysis>(F));
+  return Result(std::move(DZ));
+}
+
+PreservedAnalyses DivZeroPrinterPass::run(Function &F,
+                                          FunctionAnalysisManager &FAM) {
+  raw_ostream &OS = this->OS ? *this->OS : textReportStream();
+  OS << "Running DivZero on " << F.getName() << "\n";
+  FAM.getResult<PointerAnalysisPass>(F).print(errs());
+  auto &Result = FAM.getResult<DivZeroAnalysisPass>(F);
+  OS << "Potential Instructions by DivZero: \n";
+  for (auto I : Result.getErrorInsts()) {
+    OS << *I << "\n";
+  }
+  return PreservedAnalyses::all();
+}
+
+PreservedAnalyses DivZeroReportPass::run(Module &M, ModuleAnalysisManager &MAM) {
+  std::unique_ptr<Reporter> Report =
+      Reporter::createFromOptions("DivZero", "-");
+  if (!Report)
+    return PreservedAnalyses::all();
+
+  auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  if (useModulePointerAnalysis())
+    MAM.getResult<ModulePointerAnalysisPass>(M);
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    auto &Result = FAM.getResult<DivZeroAnalysisPass>(F);
+    for (auto I : Result.getErrorInsts())
+      Report->report(
+          Finding(I, Result.getFindingState(I), Result.getFindingRule(I),
+                  Result.getFindingMessage(I)));
+  }
+  return PreservedAnalyses::all();
+}
 } // namespace dataflow
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "DivZero", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            PB.registerAnalysisRegistrationCallback(
+                [](FunctionAnalysisManager &FAM) {
+                  FAM.registerPass([] { return dataflow::PointerAnalysisPass(); });
+                  FAM.registerPass([] { return dataflow::DivZeroAnalysisPass(); });
+                  FAM.registerPass([] { return dataflow::DivZeroQueryAnalysis(); });
+                });
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                  MAM.registerPass(
+                      [] { return dataflow::ModulePointerAnalysisPass(); });
+                });
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, FunctionPassManager &FPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name != "divzero")
+                    return false;
+                  FPM.addPass(dataflow::DivZeroPrinterPass());
+                  return true;
+                });
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "divzero-report") {
+                    dataflow::Reporter::setDefaultPath("-");
+                    MPM.addPass(dataflow::DivZeroReportPass());
+                    return true;
+                  }
+                  // At module level the module-wide points-to facts can be
+                  // solved before the functions ask for their views.
+                  if (Name != "divzero")
+                    return false;
+                  if (dataflow::useModulePointerAnalysis())
+                    MPM.addPass(RequireAnalysisPass<
+                                dataflow::ModulePointerAnalysisPass, Module>());
+                  MPM.addPass(createModuleToFunctionPassAdaptor(
+                      dataflow::DivZeroPrinterPass()));
+                  return true;
+                });
+          }};
+}
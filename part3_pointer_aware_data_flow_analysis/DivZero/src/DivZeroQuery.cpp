@@ -0,0 +1,370 @@
+#include "DivZeroQuery.h"
+
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/InstIterator.h"
+
+#include "DataflowAnalysis.h"
+#include "Feasibility.h"
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Demand-Driven Query Implementation
+//===----------------------------------------------------------------------===//
+
+static Domain MZ(Domain::MaybeZero); // Maybe Zero
+static Domain Z(Domain::Zero);       // Zero
+static Domain NZ(Domain::NonZero);   // Non Zero
+
+static Domain *constant(ConstantInt *CI) { return CI->isZero() ? &Z : &NZ; }
+
+DivZeroQuery::DivZeroQuery(Function &F, PointerAnalysis &PA,
+                           ScalarEvolution *SE)
+    : F(F), PA(PA), Induction(InductionInfo::create(F, SE)) {
+  unsigned Pos = 0;
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    Position[&*I] = Pos++;
+    if (I->getType()->isPointerTy())
+      PointerSet.insert(&*I);
+  }
+  for (Argument &Arg : F.args()) {
+    if (Arg.getType()->isPointerTy())
+      PointerSet.insert(&Arg);
+  }
+}
+
+const std::string &DivZeroQuery::name(Value *V) {
+  auto It = Names.find(V);
+  if (It == Names.end())
+    It = Names.insert({V, variable(V)}).first;
+  return It->second;
+}
+
+const std::vector<Value *> &DivZeroQuery::aliasesOf(Value *P) {
+  auto It = Aliases.find(P);
+  if (It != Aliases.end())
+    return It->second;
+
+  std::vector<Value *> Result;
+  std::string PName = name(P);
+  for (Value *Q : PointerSet) {
+    std::string QName = name(Q);
+    if (Q != P && PA.alias(PName, QName))
+      Result.push_back(Q);
+  }
+  return Aliases[P] = std::move(Result);
+}
+
+/**
+ * Find or create the fact (K, V, BB). New facts are queued on New so their
+ * own dependencies get explored; facts from earlier queries are reused.
+ */
+unsigned DivZeroQuery::demand(Node::Kind K, Value *V, BasicBlock *BB,
+                              std::vector<unsigned> &New) {
+  NodeKey Key(K, V, BB);
+  auto It = NodeIndex.find(Key);
+  if (It != NodeIndex.end())
+    return It->second;
+
+  // Order facts the way DivZeroAnalysis first visits them: a block's incoming
+  // cells and reachability right before its first instruction, its outgoing
+  // edges at its terminator, everything else at its defining instruction.
+  unsigned Order = 0;
+  if (K == Node::CellIn || K == Node::Reach)
+    Order = 2 * Position[&BB->front()];
+  else if (K == Node::Edge)
+    Order = 2 * Position[BB->getTerminator()] + 1;
+  else if (Instruction *I = dyn_cast<Instruction>(V))
+    Order = 2 * Position[I] + 1;
+
+  unsigned Idx = Nodes.size();
+  Node N;
+  N.K = K;
+  N.V = V;
+  N.BB = BB;
+  N.Order = Order;
+  Nodes.push_back(std::move(N));
+  NodeIndex[Key] = Idx;
+  New.push_back(Idx);
+  return Idx;
+}
+
+/**
+ * The fact read when At looks up operand Op: nothing for a constant, the
+ * pointer's cell for a pointer, and the SSA value otherwise.
+ */
+int DivZeroQuery::demandValue(Value *Op, Instruction *At,
+                              std::vector<unsigned> &New) {
+  if (isa<ConstantInt>(Op))
+    return -1;
+  if (Op->getType()->isPointerTy())
+    return demandCell(Op, At->getParent(), At->getIterator(), New);
+  return demand(Node::Value, Op, nullptr, New);
+}
+
+/**
+ * The fact holding P's cell right before From in BB: the closest store that
+ * writes it (directly or through an alias), the cast defining P, or the
+ * cell's value on entry to BB.
+ */
+int DivZeroQuery::demandCell(Value *P, BasicBlock *BB,
+                             BasicBlock::iterator From,
+                             std::vector<unsigned> &New) {
+  for (BasicBlock::iterator It = From; It != BB->begin();) {
+    --It;
+    if (StoreInst *SI = dyn_cast<StoreInst>(&*It)) {
+      if (!SI->getValueOperand()->getType()->isIntegerTy())
+        continue;
+      Value *Ptr = SI->getPointerOperand();
+      if (Ptr == P)
+        return demand(Node::Written, SI, nullptr, New);
+      const std::vector<Value *> &PtrAliases = aliasesOf(Ptr);
+      if (std::find(PtrAliases.begin(), PtrAliases.end(), P) !=
+          PtrAliases.end())
+        return demand(Node::Written, SI, nullptr, New);
+    } else if (&*It == P && isa<CastInst>(P)) {
+      return demand(Node::Value, P, nullptr, New);
+    }
+  }
+  return demand(Node::CellIn, P, BB, New);
+}
+
+/// The fact deciding whether From -> To is taken, -1 if edges are not tracked.
+int DivZeroQuery::demandEdge(BasicBlock *From, BasicBlock *To,
+                             std::vector<unsigned> &New) {
+  if (!pruneInfeasibleBranches())
+    return -1;
+  return demand(Node::Edge, To, From, New);
+}
+
+void DivZeroQuery::explore(unsigned Idx, std::vector<unsigned> &New) {
+  SmallVector<int, 4> Deps;
+  Node::Kind K = Nodes[Idx].K;
+  Value *V = Nodes[Idx].V;
+  BasicBlock *BB = Nodes[Idx].BB;
+
+  if (K == Node::CellIn) {
+    for (BasicBlock *Pred : predecessors(BB)) {
+      Deps.push_back(demandCell(V, Pred, Pred->end(), New));
+      Deps.push_back(demandEdge(Pred, BB, New));
+    }
+  } else if (K == Node::Edge) {
+    Instruction *Term = BB->getTerminator();
+    Deps.push_back(demand(Node::Reach, nullptr, BB, New));
+    Value *Cond = branchCondition(Term);
+    Deps.push_back(Cond ? demandValue(Cond, Term, New) : -1);
+  } else if (K == Node::Reach) {
+    for (BasicBlock *Pred : predecessors(BB))
+      Deps.push_back(demandEdge(Pred, BB, New));
+  } else if (K == Node::Written) {
+    StoreInst *SI = cast<StoreInst>(V);
+    Deps.push_back(demandValue(SI->getValueOperand(), SI, New));
+  } else if (BinaryOperator *BO = dyn_cast<BinaryOperator>(V)) {
+    Deps.push_back(demandValue(BO->getOperand(0), BO, New));
+    Deps.push_back(demandValue(BO->getOperand(1), BO, New));
+  } else if (CastInst *CI = dyn_cast<CastInst>(V)) {
+    Deps.push_back(demandValue(CI->getOperand(0), CI, New));
+  } else if (CmpInst *CMI = dyn_cast<CmpInst>(V)) {
+    Deps.push_back(demandValue(CMI->getOperand(0), CMI, New));
+    Deps.push_back(demandValue(CMI->getOperand(1), CMI, New));
+  } else if (LoadInst *LI = dyn_cast<LoadInst>(V)) {
+    Value *Ptr = LI->getPointerOperand();
+    Deps.push_back(demandCell(Ptr, LI->getParent(), LI->getIterator(), New));
+    for (Value *Q : aliasesOf(Ptr))
+      Deps.push_back(demandCell(Q, LI->getParent(), LI->getIterator(), New));
+  } else if (PHINode *PN = dyn_cast<PHINode>(V)) {
+    if (PN->getType()->isIntegerTy()) {
+      for (unsigned In = 0; In < PN->getNumIncomingValues(); ++In) {
+        Deps.push_back(demandValue(PN->getIncomingValue(In), PN, New));
+        Deps.push_back(demandEdge(PN->getIncomingBlock(In), PN->getParent(),
+                                  New));
+      }
+    }
+  }
+
+  // Nodes may have been reallocated by the demands above.
+  for (int Dep : Deps) {
+    if (Dep >= 0)
+      Nodes[Dep].Users.push_back(Idx);
+  }
+  Nodes[Idx].Deps = std::move(Deps);
+}
+
+/**
+ * Mirror of DivZeroAnalysis::transfer restricted to the fact N. A dependency
+ * that has not been computed yet behaves like a missing Memory key.
+ */
+Domain *DivZeroQuery::evaluate(const Node &N) {
+  auto Read = [&](unsigned Dep, Value *Op) -> Domain * {
+    if (ConstantInt *CI = dyn_cast<ConstantInt>(Op))
+      return constant(CI);
+    Domain *State = Nodes[N.Deps[Dep]].State;
+    return State ? State : &MZ;
+  };
+  auto Feasible = [&](unsigned Dep) {
+    return N.Deps[Dep] < 0 || Nodes[N.Deps[Dep]].State;
+  };
+
+  if (N.K == Node::CellIn) {
+    // Missing predecessor cells do not take part in the join, and neither do
+    // edges that are never taken.
+    Domain *Result = nullptr;
+    for (unsigned Dep = 0; Dep < N.Deps.size(); Dep += 2) {
+      Domain *State = Nodes[N.Deps[Dep]].State;
+      if (State && Feasible(Dep + 1))
+        Result = Result ? Domain::join(Result, State) : State;
+    }
+    return Result;
+  }
+  if (N.K == Node::Edge) {
+    // Edges stay feasible once they are, like DivZeroAnalysis's.
+    if (N.State || !Nodes[N.Deps[0]].State)
+      return N.State;
+    Instruction *Term = N.BB->getTerminator();
+    Domain *Cond = N.Deps[1] >= 0 ? Nodes[N.Deps[1]].State : nullptr;
+    SmallBitVector Taken;
+    feasibleSuccessors(Term, Cond, Taken);
+    for (unsigned Idx : Taken.set_bits()) {
+      if (Term->getSuccessor(Idx) == N.V)
+        return &NZ;
+    }
+    return nullptr;
+  }
+  if (N.K == Node::Reach) {
+    if (N.BB->isEntryBlock())
+      return &NZ;
+    for (unsigned Dep = 0; Dep < N.Deps.size(); ++Dep) {
+      if (Feasible(Dep))
+        return &NZ;
+    }
+    return nullptr;
+  }
+  if (N.K == Node::Written)
+    return Read(0, cast<StoreInst>(N.V)->getValueOperand());
+
+  Instruction *I = dyn_cast<Instruction>(N.V);
+  if (I && Induction && Induction->isNeverZero(I))
+    return &NZ;
+  if (BinaryOperator *BO = dyn_cast<BinaryOperator>(N.V)) {
+    if (BO->getOpcode() == Instruction::Sub &&
+        BO->getOperand(0) == BO->getOperand(1))
+      return &Z;
+    Domain *A = Read(0, BO->getOperand(0));
+    Domain *B = Read(1, BO->getOperand(1));
+    switch (BO->getOpcode()) {
+    case Instruction::Add:
+      return Domain::add(A, B);
+    case Instruction::Sub:
+      return Domain::sub(A, B);
+    case Instruction::Mul:
+      return Domain::mul(A, B);
+    case Instruction::SDiv:
+    case Instruction::UDiv:
+      return Domain::div(A, B);
+    default:
+      return &MZ;
+    }
+  }
+  if (CastInst *CI = dyn_cast<CastInst>(N.V))
+    return Read(0, CI->getOperand(0));
+  if (CmpInst *CMI = dyn_cast<CmpInst>(N.V)) {
+    ConstantInt *CA = dyn_cast<ConstantInt>(CMI->getOperand(0));
+    ConstantInt *CB = dyn_cast<ConstantInt>(CMI->getOperand(1));
+    if (!CA || !CB) {
+      Domain *Folded = compareWithZero(CMI, Read(0, CMI->getOperand(0)),
+                                       Read(1, CMI->getOperand(1)));
+      return Folded ? Folded : &MZ;
+    }
+    return ICmpInst::compare(CA->getValue(), CB->getValue(),
+                             CMI->getPredicate())
+               ? &NZ
+               : &Z;
+  }
+  if (isa<LoadInst>(N.V)) {
+    Domain *Cell = Nodes[N.Deps[0]].State;
+    Domain *Result = Cell ? Cell : &MZ;
+    for (unsigned Dep = 1; Dep < N.Deps.size(); ++Dep) {
+      if (Domain *Alias = Nodes[N.Deps[Dep]].State)
+        Result = Domain::join(Result, Alias);
+    }
+    return Result;
+  }
+  if (PHINode *PN = dyn_cast<PHINode>(N.V)) {
+    if (!PN->getType()->isIntegerTy())
+      return &MZ;
+    Domain *Result = nullptr;
+    for (unsigned Dep = 0; Dep < N.Deps.size(); Dep += 2) {
+      if (!Feasible(Dep + 1))
+        continue;
+      Domain *In = Read(Dep, PN->getIncomingValue(Dep / 2));
+      Result = Result ? Domain::join(Result, In) : In;
+    }
+    return Result ? Result : &MZ;
+  }
+  // Calls and everything DivZeroAnalysis does not model read as MaybeZero.
+  return &MZ;
+}
+
+/**
+ * Explore the facts the fact (K, V, BB) depends on, then run the
+ * DivZeroAnalysis worklist over just those facts, seeded in program order,
+ * until they settle. Facts solved by earlier queries are final and only read.
+ */
+Domain *DivZeroQuery::solve(Node::Kind K, Value *V, BasicBlock *BB) {
+  std::vector<unsigned> New;
+  unsigned Root = demand(K, V, BB, New);
+  for (size_t I = 0; I < New.size(); ++I)
+    explore(New[I], New);
+
+  std::stable_sort(New.begin(), New.end(), [this](unsigned A, unsigned B) {
+    return Nodes[A].Order < Nodes[B].Order;
+  });
+  SetVector<unsigned> WorkSet(New.begin(), New.end());
+  while (!WorkSet.empty()) {
+    unsigned Idx = WorkSet.front();
+    WorkSet.remove(Idx);
+
+    Domain *Old = Nodes[Idx].State;
+    Domain *State = evaluate(Nodes[Idx]);
+    Nodes[Idx].State = State;
+    if (Old == State || (Old && State && Old->Value == State->Value))
+      continue;
+    for (unsigned User : Nodes[Idx].Users) {
+      if (!Nodes[User].Final)
+        WorkSet.insert(User);
+    }
+  }
+
+  for (unsigned Idx : New)
+    Nodes[Idx].Final = true;
+  return Nodes[Root].State;
+}
+
+Domain *DivZeroQuery::getValueState(Value *V) {
+  if (ConstantInt *CI = dyn_cast<ConstantInt>(V))
+    return constant(CI);
+  Domain *State = solve(Node::Value, V, nullptr);
+  return State ? State : &MZ;
+}
+
+bool DivZeroQuery::isReachable(BasicBlock *BB) {
+  if (!pruneInfeasibleBranches())
+    return true;
+  return solve(Node::Reach, nullptr, BB) != nullptr;
+}
+
+bool DivZeroQuery::invalidate(Function &F, const PreservedAnalyses &PA,
+                              FunctionAnalysisManager::Invalidator &Inv) {
+  auto PAC = PA.getChecker<DivZeroQueryAnalysis>();
+  return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>()) ||
+         Inv.invalidate<PointerAnalysisPass>(F, PA);
+}
+
+AnalysisKey DivZeroQueryAnalysis::Key;
+
+DivZeroQuery DivZeroQueryAnalysis::run(Function &F,
+                                       FunctionAnalysisManager &FAM) {
+  return DivZeroQuery(F, FAM.getResult<PointerAnalysisPass>(F),
+                      &FAM.getResult<ScalarEvolutionAnalysis>(F));
+}
+} // namespace dataflow
@@ -0,0 +1,139 @@
+#include "DivisionSlice.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/InstIterator.h"
+
+#include "DataflowAnalysis.h"
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Division Slice Implementation
+//===----------------------------------------------------------------------===//
+
+namespace {
+/**
+ * Pointers indexed by the locations they may point to, so the pointers that
+ * may alias a given one are found without asking PointerAnalysis about every
+ * pair. Two pointers alias exactly when they share a location.
+ */
+class AliasIndex {
+public:
+  explicit AliasIndex(const PointerAnalysis &PA) : PA(PA) {}
+
+  void add(Value *P, const std::string &Name) {
+    if (const PointsToSet *S = PA.pointsTo(Name)) {
+      for (const std::string &Loc : *S)
+        At[Loc].push_back(P);
+    }
+  }
+
+  /// Call Fn on every added pointer that may alias Name, maybe repeatedly.
+  template <typename CallbackT>
+  void forEachAlias(const std::string &Name, CallbackT Fn) const {
+    const PointsToSet *S = PA.pointsTo(Name);
+    if (!S)
+      return;
+    for (const std::string &Loc : *S) {
+      auto It = At.find(Loc);
+      if (It == At.end())
+        continue;
+      for (Value *Q : It->second)
+        Fn(Q);
+    }
+  }
+
+private:
+  const PointerAnalysis &PA;
+  std::map<std::string, SmallVector<Value *, 4>> At;
+};
+} // namespace
+
+DivisionSlice::DivisionSlice(Function &F, PointerAnalysis &PA,
+                             const SetVector<Value *> &PointerSet,
+                             ArrayRef<Value *> Roots)
+    : Empty(Roots.empty()) {
+  if (Empty)
+    return;
+  std::map<Value *, std::string> Names;
+  auto Name = [&Names](Value *V) -> std::string & {
+    std::string &N = Names[V];
+    if (N.empty())
+      N = variable(V);
+    return N;
+  };
+
+  // Integer stores grouped by the pointer they write through.
+  DenseMap<Value *, SmallVector<StoreInst *, 2>> Stores;
+  AliasIndex StorePointers(PA);
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    if (StoreInst *SI = dyn_cast<StoreInst>(&*I)) {
+      if (!SI->getValueOperand()->getType()->isIntegerTy())
+        continue;
+      SmallVector<StoreInst *, 2> &Through = Stores[SI->getPointerOperand()];
+      if (Through.empty())
+        StorePointers.add(SI->getPointerOperand(), Name(SI->getPointerOperand()));
+      Through.push_back(SI);
+    }
+  }
+  AliasIndex Pointers(PA);
+  for (Value *P : PointerSet)
+    Pointers.add(P, Name(P));
+
+  // Keys the divisors depend on: SSA values for integers, memory cells for
+  // pointers.
+  SetVector<Value *> Keys;
+  SmallPtrSet<Value *, 16> LoadedFrom;
+  auto Need = [&Keys](Value *V) {
+    if (!isa<ConstantInt>(V))
+      Keys.insert(V);
+  };
+  for (Value *Root : Roots)
+    Need(Root);
+
+  for (size_t Idx = 0; Idx < Keys.size(); ++Idx) {
+    Value *V = Keys[Idx];
+    if (V->getType()->isPointerTy()) {
+      // A cell is written by the integer stores through it or an alias, and
+      // by the cast defining it.
+      auto WrittenThrough = [&](Value *Ptr) {
+        auto It = Stores.find(Ptr);
+        if (It == Stores.end())
+          return;
+        for (StoreInst *SI : It->second) {
+          if (Relevant.insert(SI).second)
+            Need(SI->getValueOperand());
+        }
+      };
+      WrittenThrough(V);
+      StorePointers.forEachAlias(Name(V), WrittenThrough);
+      if (CastInst *CI = dyn_cast<CastInst>(V)) {
+        Relevant.insert(CI);
+        Need(CI->getOperand(0));
+      }
+      continue;
+    }
+
+    Instruction *I = dyn_cast<Instruction>(V);
+    if (!I)
+      continue;
+    Relevant.insert(I);
+    if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+      // Many loads read through the same pointer; its aliases only need to
+      // be needed once.
+      Value *Ptr = LI->getPointerOperand();
+      Need(Ptr);
+      if (!LoadedFrom.insert(Ptr).second)
+        continue;
+      Pointers.forEachAlias(Name(Ptr), [&](Value *P) {
+        if (P != Ptr)
+          Need(P);
+      });
+    } else if (isa<BinaryOperator>(I) || isa<CastInst>(I) ||
+               isa<PHINode>(I) || isa<CmpInst>(I)) {
+      for (Value *Op : I->operands())
+        Need(Op);
+    }
+  }
+}
+} // namespace dataflow
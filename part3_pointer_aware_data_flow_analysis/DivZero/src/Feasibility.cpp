@@ -0,0 +1,82 @@
+#include "Feasibility.h"
+
+#include "llvm/Support/CommandLine.h"
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Branch Feasibility Implementation
+//===----------------------------------------------------------------------===//
+
+static Domain Z(Domain::Zero);     // Zero
+static Domain NZ(Domain::NonZero); // Non Zero
+
+static cl::opt<bool> PruneBranches(
+    "divzero-prune-branches", cl::init(true),
+    cl::desc("Fold branch conditions, only follow edges whose condition "
+             "may hold and skip blocks that are never reached"));
+
+bool pruneInfeasibleBranches() { return PruneBranches; }
+
+Value *branchCondition(Instruction *Term) {
+  if (BranchInst *BI = dyn_cast<BranchInst>(Term))
+    return BI->isConditional() ? BI->getCondition() : nullptr;
+  if (SwitchInst *SI = dyn_cast<SwitchInst>(Term))
+    return SI->getCondition();
+  return nullptr;
+}
+
+void feasibleSuccessors(Instruction *Term, Domain *Cond,
+                        SmallBitVector &Taken) {
+  unsigned NumSuccs = Term->getNumSuccessors();
+  Taken.clear();
+  Taken.resize(NumSuccs);
+
+  Value *C = branchCondition(Term);
+  ConstantInt *CI = C ? dyn_cast<ConstantInt>(C) : nullptr;
+  bool Known = CI || (Cond && (Cond->Value == Domain::Zero ||
+                               Cond->Value == Domain::NonZero));
+  if (!C || !Known) {
+    Taken.set();
+    return;
+  }
+
+  if (isa<BranchInst>(Term)) {
+    bool IsTrue = CI ? !CI->isZero() : Cond->Value == Domain::NonZero;
+    Taken.set(IsTrue ? 0 : 1);
+    return;
+  }
+
+  // Only zero is known exactly for a switch on a non-constant.
+  SwitchInst *SI = cast<SwitchInst>(Term);
+  if (!CI) {
+    if (Cond->Value != Domain::Zero) {
+      Taken.set();
+      return;
+    }
+    CI = ConstantInt::get(cast<IntegerType>(SI->getCondition()->getType()), 0);
+  }
+  Taken.set(SI->findCaseValue(CI)->getSuccessorIndex());
+}
+
+Domain *compareWithZero(CmpInst *Cmp, Domain *A, Domain *B) {
+  CmpInst::Predicate Pred = Cmp->getPredicate();
+  if (!PruneBranches ||
+      (Pred != CmpInst::ICMP_EQ && Pred != CmpInst::ICMP_NE))
+    return nullptr;
+
+  Domain *Other = nullptr;
+  ConstantInt *C0 = dyn_cast<ConstantInt>(Cmp->getOperand(0));
+  ConstantInt *C1 = dyn_cast<ConstantInt>(Cmp->getOperand(1));
+  if (C1 && C1->isZero() && !C0)
+    Other = A;
+  else if (C0 && C0->isZero() && !C1)
+    Other = B;
+  if (!Other ||
+      (Other->Value != Domain::Zero && Other->Value != Domain::NonZero))
+    return nullptr;
+
+  bool IsZero = Other->Value == Domain::Zero;
+  return (Pred == CmpInst::ICMP_EQ) == IsZero ? &NZ : &Z;
+}
+} // namespace dataflow
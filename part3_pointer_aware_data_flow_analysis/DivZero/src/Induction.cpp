@@ -0,0 +1,176 @@
+#include "Induction.h"
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/CommandLine.h"
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Induction Variable Recognition
+//===----------------------------------------------------------------------===//
+
+static cl::opt<bool> AccelerateInduction(
+    "divzero-induction", cl::init(true),
+    cl::desc("Give loop induction variables that never reach zero the value "
+             "NonZero directly"));
+
+/**
+ * If BO steps From by a constant with no signed wrap, return +1 or -1 for
+ * the direction of the step, and 0 otherwise.
+ */
+static int stepDirection(BinaryOperator *BO, function_ref<bool(Value *)> From) {
+  if (!BO->hasNoSignedWrap())
+    return 0;
+  Value *A = BO->getOperand(0);
+  Value *B = BO->getOperand(1);
+  if (BO->getOpcode() == Instruction::Add && isa<ConstantInt>(A))
+    std::swap(A, B);
+  ConstantInt *Step = dyn_cast<ConstantInt>(B);
+  if (!Step || Step->isZero() || !From(A))
+    return 0;
+  int Sign = Step->isNegative() ? -1 : 1;
+  if (BO->getOpcode() == Instruction::Add)
+    return Sign;
+  if (BO->getOpcode() == Instruction::Sub)
+    return -Sign;
+  return 0;
+}
+
+static int constantSign(Value *V) {
+  ConstantInt *CI = dyn_cast<ConstantInt>(V);
+  if (!CI || CI->isZero())
+    return 0;
+  return CI->isNegative() ? -1 : 1;
+}
+
+std::unique_ptr<InductionInfo> InductionInfo::create(Function &F,
+                                                     ScalarEvolution *SE) {
+  if (!AccelerateInduction)
+    return nullptr;
+  return std::unique_ptr<InductionInfo>(new InductionInfo(F, SE));
+}
+
+InductionInfo::InductionInfo(Function &F, ScalarEvolution *SE) {
+  DominatorTree DT(F);
+  LoopInfo LI(DT);
+  if (LI.empty())
+    return;
+
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    if (AllocaInst *AI = dyn_cast<AllocaInst>(&*I))
+      addCell(AI, DT, LI);
+    else if (PHINode *PN = dyn_cast<PHINode>(&*I))
+      addPHI(PN, LI);
+  }
+
+  if (!SE)
+    return;
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    if (!isa<PHINode>(&*I) && !isa<BinaryOperator>(&*I))
+      continue;
+    if (!SE->isSCEVable(I->getType()) || !LI.getLoopFor(I->getParent()))
+      continue;
+    const SCEV *S = SE->getSCEV(&*I);
+    if (!isa<SCEVAddRecExpr>(S))
+      continue;
+    APInt Zero = APInt::getNullValue(SE->getTypeSizeInBits(I->getType()));
+    if (SE->isKnownNonZero(S) || !SE->getSignedRange(S).contains(Zero) ||
+        !SE->getUnsignedRange(S).contains(Zero))
+      NeverZero.insert(&*I);
+  }
+}
+
+/**
+ * A memory induction variable, as emitted for `for (i = 1; ...; i++)`
+ * without mem2reg. Each step must read a value some non-zero constant store
+ * dominates, or it could step an uninitialised cell.
+ */
+void InductionInfo::addCell(AllocaInst *AI, const DominatorTree &DT,
+                            const LoopInfo &LI) {
+  if (!AI->getAllocatedType()->isIntegerTy())
+    return;
+
+  int Sign = 0;
+  bool InLoop = false;
+  SmallVector<Instruction *, 4> Steps;
+  SmallVector<StoreInst *, 2> Inits;
+  auto Agree = [&Sign](int S) {
+    if (!S || (Sign && S != Sign))
+      return false;
+    Sign = S;
+    return true;
+  };
+  auto LoadsCell = [AI](Value *V) {
+    LoadInst *Load = dyn_cast<LoadInst>(V);
+    return Load && Load->getPointerOperand() == AI;
+  };
+
+  for (User *U : AI->users()) {
+    if (LoadInst *Load = dyn_cast<LoadInst>(U)) {
+      if (Load->getPointerOperand() != AI)
+        return;
+      continue;
+    }
+    StoreInst *Store = dyn_cast<StoreInst>(U);
+    if (!Store || Store->getPointerOperand() != AI)
+      return; // The address escapes.
+    Value *Val = Store->getValueOperand();
+    if (isa<ConstantInt>(Val)) {
+      if (!Agree(constantSign(Val)))
+        return;
+      Inits.push_back(Store);
+      continue;
+    }
+    BinaryOperator *BO = dyn_cast<BinaryOperator>(Val);
+    if (!BO || !Agree(stepDirection(BO, LoadsCell)))
+      return;
+    Steps.push_back(BO);
+    InLoop |= LI.getLoopFor(Store->getParent()) != nullptr;
+  }
+
+  if (!InLoop)
+    return;
+  for (Instruction *Step : Steps) {
+    Instruction *Load = cast<Instruction>(
+        LoadsCell(Step->getOperand(0)) ? Step->getOperand(0)
+                                       : Step->getOperand(1));
+    if (none_of(Inits, [&](StoreInst *Init) {
+          return DT.dominates(Init, Load);
+        }))
+      return;
+  }
+  NeverZero.insert(Steps.begin(), Steps.end());
+}
+
+/**
+ * An SSA induction variable: a loop-header PHI whose incoming values are
+ * non-zero constants from outside the loop and its own steps from inside.
+ */
+void InductionInfo::addPHI(PHINode *PN, const LoopInfo &LI) {
+  Loop *L = LI.getLoopFor(PN->getParent());
+  if (!L || L->getHeader() != PN->getParent() ||
+      !PN->getType()->isIntegerTy())
+    return;
+
+  int Sign = 0;
+  SmallVector<Instruction *, 2> Steps;
+  for (unsigned Idx = 0; Idx < PN->getNumIncomingValues(); ++Idx) {
+    Value *V = PN->getIncomingValue(Idx);
+    int S = 0;
+    if (!L->contains(PN->getIncomingBlock(Idx))) {
+      S = constantSign(V);
+    } else if (BinaryOperator *BO = dyn_cast<BinaryOperator>(V)) {
+      S = stepDirection(BO, [PN](Value *Op) { return Op == PN; });
+      Steps.push_back(BO);
+    }
+    if (!S || (Sign && S != Sign))
+      return;
+    Sign = S;
+  }
+  NeverZero.insert(PN);
+  NeverZero.insert(Steps.begin(), Steps.end());
+}
+} // namespace dataflow
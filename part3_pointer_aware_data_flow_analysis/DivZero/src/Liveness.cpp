@@ -0,0 +1,111 @@
+#include "Liveness.h"
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/InstIterator.h"
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Liveness Analysis Implementation
+//===----------------------------------------------------------------------===//
+
+static bool isTracked(Value *V) {
+  return isa<Instruction>(V) && !V->getType()->isPointerTy() &&
+         !V->getType()->isVoidTy();
+}
+
+Liveness::Liveness(Function &F) {
+  // Number the tracked values so block sets are plain bit vectors.
+  DenseMap<Instruction *, unsigned> Index;
+  std::vector<Instruction *> Values;
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    if (isTracked(&*I)) {
+      Index[&*I] = Values.size();
+      Values.push_back(&*I);
+    }
+  }
+  if (Values.empty())
+    return;
+
+  // Per block: values used before being defined (Gen) and values defined.
+  DenseMap<BasicBlock *, BitVector> Gen, Kill, LiveIn, LiveOut;
+  for (BasicBlock &BB : F) {
+    BitVector &G = Gen[&BB];
+    BitVector &K = Kill[&BB];
+    G.resize(Values.size());
+    K.resize(Values.size());
+    LiveIn[&BB].resize(Values.size());
+    LiveOut[&BB].resize(Values.size());
+    for (Instruction &I : BB) {
+      for (Value *Op : I.operands()) {
+        if (!isTracked(Op))
+          continue;
+        unsigned Idx = Index[cast<Instruction>(Op)];
+        if (!K.test(Idx))
+          G.set(Idx);
+      }
+      auto It = Index.find(&I);
+      if (It != Index.end())
+        K.set(It->second);
+    }
+  }
+
+  // Standard backward fixpoint, visiting blocks in post order.
+  std::vector<BasicBlock *> Order;
+  for (BasicBlock *BB : post_order(&F.getEntryBlock()))
+    Order.push_back(BB);
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (BasicBlock *BB : Order) {
+      BitVector Out(Values.size());
+      for (BasicBlock *Succ : successors(BB))
+        Out |= LiveIn[Succ];
+      BitVector In = Out;
+      In.reset(Kill[BB]);
+      In |= Gen[BB];
+      LiveOut[BB] = std::move(Out);
+      if (In != LiveIn[BB]) {
+        LiveIn[BB] = std::move(In);
+        Changed = true;
+      }
+    }
+  }
+
+  // Walk each block backward. Right after I, the values I reads and defines
+  // that are not live any more are dead.
+  for (BasicBlock *BB : Order) {
+    BitVector Live = LiveOut[BB];
+    for (Instruction &I : reverse(*BB)) {
+      SmallVector<Instruction *, 2> &Dead = DeadAfter[&I];
+      auto It = Index.find(&I);
+      if (It != Index.end() && !Live.test(It->second))
+        Dead.push_back(&I);
+      if (It != Index.end())
+        Live.reset(It->second);
+      for (Value *Op : I.operands()) {
+        if (!isTracked(Op))
+          continue;
+        unsigned Idx = Index[cast<Instruction>(Op)];
+        if (!Live.test(Idx)) {
+          if (std::find(Dead.begin(), Dead.end(), Op) == Dead.end())
+            Dead.push_back(cast<Instruction>(Op));
+          Live.set(Idx);
+        }
+      }
+    }
+
+    // Live is now the block's live-in set. Anything a predecessor still
+    // carries beyond that dies on entry.
+    BitVector Carried(Values.size());
+    for (BasicBlock *Pred : predecessors(BB))
+      Carried |= LiveOut[Pred];
+    Carried.reset(Live);
+    SmallVector<Instruction *, 2> &Dead = DeadAfter[&BB->front()];
+    for (unsigned Idx : Carried.set_bits())
+      Dead.push_back(Values[Idx]);
+  }
+}
+} // namespace dataflow
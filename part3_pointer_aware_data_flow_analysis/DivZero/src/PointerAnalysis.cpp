@@ -1,12 +1,30 @@
 #include "PointerAnalysis.h"
 
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/MemoryBuiltins.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ThreadPool.h"
 
 #include "DataflowAnalysis.h"
 
 namespace dataflow {
 
+static cl::opt<bool> ModulePTA(
+    "divzero-module-pta",
+    cl::desc("Solve points-to facts once for the whole module, across calls, "
+             "instead of once per function (DivZeroBatch then loads every "
+             "function body up front and keeps it)"));
+
+bool useModulePointerAnalysis() { return ModulePTA; }
+
+static cl::opt<unsigned> PTAThreads(
+    "divzero-pta-threads", cl::init(1),
+    cl::desc("Threads solving the module-wide points-to constraints "
+             "(0 = all hardware threads, 1 = serial)"));
+
 //===----------------------------------------------------------------------===//
 // Pointer Analysis Implementation
 //===----------------------------------------------------------------------===//
@@ -60,18 +78,6 @@ int countFacts(PointsToInfo &PointsTo) {
   return N;
 }
 
-void print(std::map<std::string, PointsToSet> &PointsTo) {
-  errs() << "Pointer Analysis Results:\n";
-  for (auto &I : PointsTo) {
-    errs() << "  " << I.first << ": { ";
-    for (auto &J : I.second) {
-      errs() << J << "; ";
-    }
-    errs() << "}\n";
-  }
-  errs() << "\n";
-}
-
 PointerAnalysis::PointerAnalysis(Function &F) {
   int NumOfOldFacts = 0;
   int NumOfNewFacts = 0;
@@ -85,7 +91,28 @@ PointerAnalysis::PointerAnalysis(Function &F) {
     else
       break;
   }
-  print(PointsTo);
+}
+
+hash_code PointerAnalysis::fingerprint() const {
+  hash_code Hash = hash_value(PointsTo.size());
+  for (auto &Entry : PointsTo) {
+    Hash = hash_combine(Hash, Entry.first);
+    for (const std::string &Loc : Entry.second)
+      Hash = hash_combine(Hash, Loc);
+  }
+  return Hash;
+}
+
+void PointerAnalysis::print(raw_ostream &O) const {
+  O << "Pointer Analysis Results:\n";
+  for (auto &I : PointsTo) {
+    O << "  " << I.first << ": { ";
+    for (auto &J : I.second) {
+      O << J << "; ";
+    }
+    O << "}\n";
+  }
+  O << "\n";
 }
 
 bool PointerAnalysis::alias(std::string &Ptr1, std::string &Ptr2) const {
@@ -100,4 +127,466 @@ bool PointerAnalysis::alias(std::string &Ptr1, std::string &Ptr2) const {
   return !Inter.empty();
 }
 
+//===----------------------------------------------------------------------===//
+// Module Pointer Analysis Implementation
+//===----------------------------------------------------------------------===//
+
+ModulePointerAnalysis::ModulePointerAnalysis(Module &M) {
+  for (GlobalVariable &G : M.globals()) {
+    if (G.hasInitializer())
+      addInitializer(getLocation(&G), G.getInitializer());
+  }
+
+  TargetLibraryInfoImpl TLII(Triple(M.getTargetTriple()));
+  TargetLibraryInfo TLI(TLII);
+  for (Function &F : M) {
+    for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I)
+      addConstraints(*I, TLI);
+  }
+  if (PTAThreads == 1)
+    solve();
+  else
+    solveParallel(PTAThreads);
+  Worklist.clear();
+  CopyEdges.clear();
+}
+
+/**
+ * The node of V, created on first use; -1 if V cannot hold an address, such
+ * as null or a constant integer. Constant expressions share the node of the
+ * global they are based on.
+ */
+int ModulePointerAnalysis::getNode(Value *V) {
+  if (isa<Constant>(V)) {
+    GlobalValue *G = dyn_cast<GlobalValue>(getUnderlyingObject(V));
+    if (!G)
+      return -1;
+    V = G;
+  }
+  auto It = ValueNodes.find(V);
+  if (It != ValueNodes.end())
+    return It->second;
+
+  unsigned N = Nodes.size();
+  Nodes.emplace_back();
+  ValueNodes[V] = N;
+  if (isa<GlobalValue>(V)) {
+    unsigned Loc = getLocation(V);
+    Nodes[N].PointsTo.set(Loc);
+  }
+  return N;
+}
+
+int ModulePointerAnalysis::findNode(Value *V) const {
+  if (isa<Constant>(V)) {
+    V = getUnderlyingObject(V);
+    if (!isa<GlobalValue>(V))
+      return -1;
+  }
+  auto It = ValueNodes.find(V);
+  return It == ValueNodes.end() ? -1 : It->second;
+}
+
+unsigned ModulePointerAnalysis::getLocation(Value *Site) {
+  auto It = LocationIndex.find(Site);
+  if (It != LocationIndex.end())
+    return It->second;
+  unsigned Loc = Locations.size();
+  Locations.push_back(Site);
+  Contents.push_back(Nodes.size());
+  Nodes.emplace_back();
+  LocationIndex[Site] = Loc;
+  return Loc;
+}
+
+unsigned ModulePointerAnalysis::getReturnNode(Function *F) {
+  auto It = ReturnNodes.find(F);
+  if (It != ReturnNodes.end())
+    return It->second;
+  unsigned N = Nodes.size();
+  Nodes.emplace_back();
+  ReturnNodes[F] = N;
+  return N;
+}
+
+void ModulePointerAnalysis::addCopy(int From, int To) {
+  if (From < 0 || To < 0 || From == To ||
+      !CopyEdges.insert({unsigned(From), unsigned(To)}).second)
+    return;
+  Nodes[From].Copies.push_back(To);
+  if (Nodes[To].PointsTo |= Nodes[From].PointsTo)
+    Worklist.push_back(To);
+}
+
+/// Pass CB's pointer arguments to Callee and its returned pointers back.
+void ModulePointerAnalysis::addCall(CallBase &CB, Function *Callee) {
+  if (Callee->isDeclaration() || !ResolvedCalls.insert({&CB, Callee}).second)
+    return;
+  unsigned NumArgs = std::min<unsigned>(CB.arg_size(), Callee->arg_size());
+  for (unsigned Idx = 0; Idx < NumArgs; ++Idx) {
+    Value *Actual = CB.getArgOperand(Idx);
+    if (Actual->getType()->isPointerTy())
+      addCopy(getNode(Actual), getNode(Callee->getArg(Idx)));
+  }
+  if (CB.getType()->isPointerTy())
+    addCopy(getReturnNode(Callee), getNode(&CB));
+}
+
+/// Everything the initializer C puts into the global at Loc.
+void ModulePointerAnalysis::addInitializer(unsigned Loc, Constant *C) {
+  if (GlobalValue *G = dyn_cast<GlobalValue>(C)) {
+    unsigned Target = getLocation(G);
+    Nodes[Contents[Loc]].PointsTo.set(Target);
+    return;
+  }
+  for (Use &Op : C->operands()) {
+    if (Constant *OpC = dyn_cast<Constant>(Op))
+      addInitializer(Loc, OpC);
+  }
+}
+
+void ModulePointerAnalysis::addConstraints(Instruction &I,
+                                           const TargetLibraryInfo &TLI) {
+  if (AllocaInst *AI = dyn_cast<AllocaInst>(&I)) {
+    unsigned Loc = getLocation(AI);
+    Nodes[getNode(AI)].PointsTo.set(Loc);
+  } else if (isa<BitCastInst>(I) || isa<AddrSpaceCastInst>(I) ||
+             isa<GetElementPtrInst>(I)) {
+    if (I.getType()->isPointerTy())
+      addCopy(getNode(I.getOperand(0)), getNode(&I));
+  } else if (PHINode *Phi = dyn_cast<PHINode>(&I)) {
+    if (Phi->getType()->isPointerTy()) {
+      for (Value *In : Phi->incoming_values())
+        addCopy(getNode(In), getNode(Phi));
+    }
+  } else if (SelectInst *Sel = dyn_cast<SelectInst>(&I)) {
+    if (Sel->getType()->isPointerTy()) {
+      addCopy(getNode(Sel->getTrueValue()), getNode(Sel));
+      addCopy(getNode(Sel->getFalseValue()), getNode(Sel));
+    }
+  } else if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+    int P = getNode(LI->getPointerOperand());
+    if (LI->getType()->isPointerTy() && P >= 0) {
+      int N = getNode(LI);
+      Nodes[P].Loads.push_back(N);
+    }
+  } else if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+    if (!SI->getValueOperand()->getType()->isPointerTy())
+      return;
+    int P = getNode(SI->getPointerOperand());
+    int N = getNode(SI->getValueOperand());
+    if (P >= 0 && N >= 0)
+      Nodes[P].Stores.push_back(N);
+  } else if (ReturnInst *RI = dyn_cast<ReturnInst>(&I)) {
+    Value *Ret = RI->getReturnValue();
+    if (Ret && Ret->getType()->isPointerTy())
+      addCopy(getNode(Ret), getReturnNode(I.getFunction()));
+  } else if (CallBase *CB = dyn_cast<CallBase>(&I)) {
+    if (CB->getType()->isPointerTy() && isAllocationFn(CB, &TLI)) {
+      unsigned Loc = getLocation(CB);
+      Nodes[getNode(CB)].PointsTo.set(Loc);
+    } else if (Function *Callee = dyn_cast<Function>(
+                   CB->getCalledOperand()->stripPointerCasts())) {
+      addCall(*CB, Callee);
+    } else {
+      int P = getNode(CB->getCalledOperand());
+      if (P >= 0)
+        Nodes[P].Calls.push_back(CB);
+    }
+  }
+}
+
+/**
+ * Propagate along copy edges until nothing grows. A location newly reached
+ * by a pointer adds the edges of the loads, stores and indirect calls
+ * through that pointer, so each location is expanded once per pointer.
+ */
+void ModulePointerAnalysis::solve() {
+  for (unsigned N = 0; N < Nodes.size(); ++N)
+    Worklist.push_back(N);
+
+  while (!Worklist.empty()) {
+    unsigned N = Worklist.pop_back_val();
+    SparseBitVector<> New = Nodes[N].PointsTo;
+    New.intersectWithComplement(Nodes[N].Handled);
+    Nodes[N].Handled |= New;
+    for (unsigned Loc : New) {
+      unsigned Content = Contents[Loc];
+      for (unsigned Idx = 0; Idx < Nodes[N].Loads.size(); ++Idx)
+        addCopy(Content, Nodes[N].Loads[Idx]);
+      for (unsigned Idx = 0; Idx < Nodes[N].Stores.size(); ++Idx)
+        addCopy(Nodes[N].Stores[Idx], Content);
+      if (Function *Callee = dyn_cast<Function>(Locations[Loc])) {
+        for (unsigned Idx = 0; Idx < Nodes[N].Calls.size(); ++Idx)
+          addCall(*Nodes[N].Calls[Idx], Callee);
+      }
+    }
+
+    // addCall may add nodes, so index instead of holding references.
+    for (unsigned Idx = 0; Idx < Nodes[N].Copies.size(); ++Idx) {
+      unsigned To = Nodes[N].Copies[Idx];
+      if (Nodes[To].PointsTo |= Nodes[N].PointsTo)
+        Worklist.push_back(To);
+    }
+  }
+}
+
+/// Run Fn on chunks of [0, N) on Pool, or inline if N is small.
+static void parallelFor(ThreadPool &Pool, unsigned N,
+                        function_ref<void(unsigned, unsigned)> Fn) {
+  const unsigned Grain = 256;
+  if (N <= Grain) {
+    Fn(0, N);
+    return;
+  }
+  unsigned Chunks =
+      std::min(Pool.getThreadCount() * 4, (N + Grain - 1) / Grain);
+  unsigned Size = (N + Chunks - 1) / Chunks;
+  for (unsigned Begin = 0; Begin < N; Begin += Size) {
+    unsigned End = std::min(N, Begin + Size);
+    Pool.async([Fn, Begin, End] { Fn(Begin, End); });
+  }
+  Pool.wait();
+}
+
+/**
+ * Alternate between propagating along the copy edges known so far and
+ * adding the edges loads, stores and indirect calls imply for the locations
+ * that arrived, until no edge is new. Each phase only writes state owned by
+ * the node or strongly connected component a task is given, so the sets
+ * reached are those of solve().
+ */
+void ModulePointerAnalysis::solveParallel(unsigned Threads) {
+  ThreadPool Pool(hardware_concurrency(Threads));
+  do
+    propagateWave(Pool);
+  while (expandConstraints(Pool));
+}
+
+/**
+ * Bring every node up to date with the copy edges in one wave: strongly
+ * connected components are visited in topological order, all of one depth
+ * at once, and each pulls from its predecessors, which are final by then.
+ * Nodes of a cycle end up with the same set.
+ */
+void ModulePointerAnalysis::propagateWave(ThreadPool &Pool) {
+  const unsigned None = ~0u;
+  unsigned NumNodes = Nodes.size();
+  std::vector<SmallVector<unsigned, 2>> Preds(NumNodes);
+  for (unsigned N = 0; N < NumNodes; ++N) {
+    for (unsigned To : Nodes[N].Copies)
+      Preds[To].push_back(N);
+  }
+
+  // Tarjan's algorithm; components are completed in reverse topological
+  // order.
+  std::vector<unsigned> Comp(NumNodes, None), Index(NumNodes, None);
+  std::vector<unsigned> Low(NumNodes), Stack;
+  std::vector<std::vector<unsigned>> Comps;
+  std::vector<std::pair<unsigned, unsigned>> Path; // node, next copy edge
+  unsigned Next = 0;
+  for (unsigned Root = 0; Root < NumNodes; ++Root) {
+    if (Index[Root] != None)
+      continue;
+    Path.push_back({Root, 0});
+    Index[Root] = Low[Root] = Next++;
+    Stack.push_back(Root);
+    while (!Path.empty()) {
+      unsigned N = Path.back().first;
+      unsigned Edge = Path.back().second++;
+      if (Edge < Nodes[N].Copies.size()) {
+        unsigned To = Nodes[N].Copies[Edge];
+        if (Index[To] == None) {
+          Index[To] = Low[To] = Next++;
+          Stack.push_back(To);
+          Path.push_back({To, 0});
+        } else if (Comp[To] == None) {
+          Low[N] = std::min(Low[N], Index[To]);
+        }
+        continue;
+      }
+      Path.pop_back();
+      if (!Path.empty())
+        Low[Path.back().first] = std::min(Low[Path.back().first], Low[N]);
+      if (Low[N] != Index[N])
+        continue;
+      Comps.emplace_back();
+      unsigned Member;
+      do {
+        Member = Stack.back();
+        Stack.pop_back();
+        Comp[Member] = Comps.size() - 1;
+        Comps.back().push_back(Member);
+      } while (Member != N);
+    }
+  }
+
+  // Depth of each component below the ones without predecessors.
+  std::vector<unsigned> Depth(Comps.size(), 0);
+  std::vector<std::vector<unsigned>> Levels;
+  for (unsigned C = Comps.size(); C-- > 0;) {
+    if (Levels.size() <= Depth[C])
+      Levels.resize(Depth[C] + 1);
+    Levels[Depth[C]].push_back(C);
+    for (unsigned N : Comps[C]) {
+      for (unsigned To : Nodes[N].Copies) {
+        if (Comp[To] != C)
+          Depth[Comp[To]] = std::max(Depth[Comp[To]], Depth[C] + 1);
+      }
+    }
+  }
+
+  for (const std::vector<unsigned> &Level : Levels) {
+    parallelFor(Pool, Level.size(), [&](unsigned Begin, unsigned End) {
+      for (unsigned Idx = Begin; Idx < End; ++Idx) {
+        unsigned C = Level[Idx];
+        SparseBitVector<> Set;
+        for (unsigned N : Comps[C]) {
+          Set |= Nodes[N].PointsTo;
+          for (unsigned From : Preds[N]) {
+            if (Comp[From] != C)
+              Set |= Nodes[From].PointsTo;
+          }
+        }
+        for (unsigned N : Comps[C])
+          Nodes[N].PointsTo = Set;
+      }
+    });
+  }
+}
+
+/**
+ * Find the copy edges and calls implied by the locations that reached each
+ * node since the last call, in parallel, then add them in node order.
+ * Returns false if none was new, which means the sets are final.
+ */
+bool ModulePointerAnalysis::expandConstraints(ThreadPool &Pool) {
+  unsigned NumNodes = Nodes.size();
+  std::vector<std::vector<std::pair<unsigned, unsigned>>> NewCopies(NumNodes);
+  std::vector<std::vector<std::pair<CallBase *, Function *>>> NewCalls(
+      NumNodes);
+  parallelFor(Pool, NumNodes, [&](unsigned Begin, unsigned End) {
+    for (unsigned N = Begin; N < End; ++N) {
+      Node &Cur = Nodes[N];
+      SparseBitVector<> New = Cur.PointsTo;
+      New.intersectWithComplement(Cur.Handled);
+      Cur.Handled |= New;
+      for (unsigned Loc : New) {
+        unsigned Content = Contents[Loc];
+        for (unsigned Load : Cur.Loads) {
+          if (Content != Load && !CopyEdges.count({Content, Load}))
+            NewCopies[N].push_back({Content, Load});
+        }
+        for (unsigned Store : Cur.Stores) {
+          if (Store != Content && !CopyEdges.count({Store, Content}))
+            NewCopies[N].push_back({Store, Content});
+        }
+        Function *Callee = dyn_cast<Function>(Locations[Loc]);
+        if (!Callee || Callee->isDeclaration())
+          continue;
+        for (CallBase *CB : Cur.Calls) {
+          if (!ResolvedCalls.count({CB, Callee}))
+            NewCalls[N].push_back({CB, Callee});
+        }
+      }
+    }
+  });
+
+  bool Changed = false;
+  for (unsigned N = 0; N < NumNodes; ++N) {
+    for (auto &Edge : NewCopies[N]) {
+      Changed |= !CopyEdges.count(Edge);
+      addCopy(Edge.first, Edge.second);
+    }
+    for (auto &Call : NewCalls[N]) {
+      Changed |= !ResolvedCalls.count(Call);
+      addCall(*Call.first, Call.second);
+    }
+  }
+  return Changed;
+}
+
+/**
+ * A name unique in the module: globals and functions by their name, other
+ * sites like address() does, qualified with their function.
+ */
+std::string ModulePointerAnalysis::locationName(unsigned Loc) const {
+  Value *Site = Locations[Loc];
+  if (!isa<GlobalValue>(Site)) {
+    std::string Name = address(Site);
+    Name.insert(1, cast<Instruction>(Site)->getFunction()->getName().str());
+    return Name;
+  }
+  std::string Name;
+  raw_string_ostream SS(Name);
+  SS << "@(";
+  Site->printAsOperand(SS, false);
+  SS << ")";
+  return SS.str();
+}
+
+PointerAnalysis ModulePointerAnalysis::getFunctionView(Function &F) const {
+  PointerAnalysis View;
+  DenseMap<unsigned, std::string> Names;
+  auto Add = [&](Value *V) {
+    int N = findNode(V);
+    if (N < 0 || Nodes[N].PointsTo.empty())
+      return;
+    PointsToSet &S = View.PointsTo[variable(V)];
+    for (unsigned Loc : Nodes[N].PointsTo) {
+      auto It = Names.find(Loc);
+      if (It == Names.end())
+        It = Names.insert({Loc, locationName(Loc)}).first;
+      S.insert(It->second);
+    }
+  };
+
+  for (Argument &Arg : F.args()) {
+    if (Arg.getType()->isPointerTy())
+      Add(&Arg);
+  }
+  SmallPtrSet<Constant *, 8> Seen;
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    if (I->getType()->isPointerTy())
+      Add(&*I);
+    for (Value *Op : I->operands()) {
+      Constant *C = dyn_cast<Constant>(Op);
+      if (C && C->getType()->isPointerTy() && !isa<Function>(C) &&
+          Seen.insert(C).second)
+        Add(C);
+    }
+  }
+  return View;
+}
+
+bool ModulePointerAnalysis::invalidate(Module &M, const PreservedAnalyses &PA,
+                                       ModuleAnalysisManager::Invalidator &Inv) {
+  auto PAC = PA.getChecker<ModulePointerAnalysisPass>();
+  return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Module>>());
+}
+
+AnalysisKey PointerAnalysisPass::Key;
+
+PointerAnalysis PointerAnalysisPass::run(Function &F,
+                                         FunctionAnalysisManager &FAM) {
+  if (useModulePointerAnalysis()) {
+    auto &MAMProxy = FAM.getResult<ModuleAnalysisManagerFunctionProxy>(F);
+    if (auto *MPA = MAMProxy.getCachedResult<ModulePointerAnalysisPass>(
+            *F.getParent())) {
+      // The view must not outlive the module facts it was taken from.
+      MAMProxy.registerOuterAnalysisInvalidation<ModulePointerAnalysisPass,
+                                                 PointerAnalysisPass>();
+      return MPA->getFunctionView(F);
+    }
+  }
+  return PointerAnalysis(F);
+}
+
+AnalysisKey ModulePointerAnalysisPass::Key;
+
+ModulePointerAnalysis ModulePointerAnalysisPass::run(Module &M,
+                                                     ModuleAnalysisManager &MAM) {
+  return ModulePointerAnalysis(M);
+}
+
 }; // namespace dataflow
@@ -0,0 +1,238 @@
+#include "Reporter.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Path.h"
+
+namespace dataflow {
+
+//===----------------------------------------------------------------------===//
+// Finding Reporter Implementation
+//===----------------------------------------------------------------------===//
+
+static cl::opt<std::string>
+    ReportPath("divzero-report", cl::init(""),
+               cl::desc("Write findings to this file ('-' for stdout)"),
+               cl::value_desc("filename"));
+
+static cl::opt<Reporter::Format> ReportFormat(
+    "divzero-report-format", cl::init(Reporter::SARIF),
+    cl::desc("Format of the -divzero-report file"),
+    cl::values(clEnumValN(Reporter::SARIF, "sarif", "SARIF 2.1.0 log"),
+               clEnumValN(Reporter::JSONL, "jsonl", "One JSON object per line")));
+
+// Report path used when -divzero-report is not given.
+static std::string DefaultReportPath;
+
+// Flush to the file in chunks of this many bytes.
+static const size_t ReportBufferSize = 64 * 1024;
+
+const char *stateName(Domain *State) {
+  if (!State)
+    return "Unknown";
+  switch (State->Value) {
+  case Domain::Uninit:
+    return "Uninit";
+  case Domain::NonZero:
+    return "NonZero";
+  case Domain::Zero:
+    return "Zero";
+  case Domain::MaybeZero:
+    return "MaybeZero";
+  }
+  return "Unknown";
+}
+
+raw_ostream &textReportStream() {
+  return Reporter::writesToStdout() ? errs() : outs();
+}
+
+/**
+ * Write S as a quoted JSON string.
+ */
+static void writeString(raw_ostream &OS, StringRef S) {
+  OS << '"';
+  for (unsigned char C : S) {
+    switch (C) {
+    case '"':
+      OS << "\\\"";
+      break;
+    case '\\':
+      OS << "\\\\";
+      break;
+    case '\n':
+      OS << "\\n";
+      break;
+    case '\r':
+      OS << "\\r";
+      break;
+    case '\t':
+      OS << "\\t";
+      break;
+    default:
+      if (C < 0x20)
+        OS << format("\\u%04x", C);
+      else
+        OS << C;
+    }
+  }
+  OS << '"';
+}
+
+/**
+ * Percent-encode Path for use in a URI, keeping unreserved characters and
+ * the '/' separators.
+ */
+static std::string escapeURIPath(StringRef Path) {
+  std::string URI;
+  raw_string_ostream OS(URI);
+  for (unsigned char C : Path) {
+    if (isAlnum(C) || C == '-' || C == '.' || C == '_' || C == '~' ||
+        C == '/')
+      OS << C;
+    else
+      OS << format("%%%02X", C);
+  }
+  return OS.str();
+}
+
+/**
+ * Write the SARIF artifactLocation of File: a file:// URI if the path is
+ * absolute, otherwise a reference relative to the SRCROOT base, which the
+ * run maps to the working directory.
+ */
+static void writeArtifactLocation(raw_ostream &OS, StringRef File) {
+  OS << "{\"uri\": ";
+  if (sys::path::is_absolute(File)) {
+    writeString(OS, "file://" + escapeURIPath(File));
+    OS << "}";
+    return;
+  }
+  writeString(OS, escapeURIPath(File));
+  OS << ", \"uriBaseId\": \"SRCROOT\"}";
+}
+
+Finding::Finding(Instruction *I, Domain *State, StringRef Rule,
+                 StringRef Message)
+    : Rule(Rule.str()), Message(Message.str()), Function(I->getFunction()->getName().str()),
+      State(stateName(State)) {
+  if (DILocation *Loc = I->getDebugLoc().get()) {
+    SmallString<128> Path(Loc->getDirectory());
+    if (Path.empty() || sys::path::is_absolute(Loc->getFilename()))
+      Path = Loc->getFilename();
+    else
+      sys::path::append(Path, Loc->getFilename());
+    File = Path.str().str();
+    Line = Loc->getLine();
+    Column = Loc->getColumn();
+  } else {
+    File = I->getModule()->getSourceFileName();
+  }
+}
+
+Reporter::Reporter(raw_ostream &OS, Format Fmt, StringRef ToolName)
+    : OS(OS), Fmt(Fmt) {
+  if (Fmt != SARIF)
+    return;
+  OS << "{\n"
+     << "  \"$schema\": \"https://json.schemastore.org/sarif-2.1.0.json\",\n"
+     << "  \"version\": \"2.1.0\",\n"
+     << "  \"runs\": [{\n"
+     << "    \"tool\": {\"driver\": {\"name\": ";
+  writeString(OS, ToolName);
+  OS << "}},\n";
+  SmallString<128> Root;
+  if (!sys::fs::current_path(Root)) {
+    Root.push_back('/');
+    OS << "    \"originalUriBaseIds\": {\"SRCROOT\": {\"uri\": ";
+    writeString(OS, "file://" + escapeURIPath(Root));
+    OS << "}},\n";
+  }
+  OS << "    \"results\": [";
+}
+
+Reporter::~Reporter() { finish(); }
+
+static StringRef reportPath(StringRef DefaultPath) {
+  if (!ReportPath.empty())
+    return ReportPath;
+  return DefaultPath.empty() ? StringRef(DefaultReportPath) : DefaultPath;
+}
+
+void Reporter::setDefaultPath(StringRef Path) { DefaultReportPath = Path.str(); }
+
+bool Reporter::writesToStdout(StringRef DefaultPath) {
+  return reportPath(DefaultPath) == "-";
+}
+
+std::unique_ptr<Reporter> Reporter::createFromOptions(StringRef ToolName,
+                                                      StringRef DefaultPath) {
+  StringRef Path = reportPath(DefaultPath);
+  if (Path.empty())
+    return nullptr;
+
+  if (Path == "-")
+    return std::unique_ptr<Reporter>(new Reporter(outs(), ReportFormat, ToolName));
+
+  std::error_code EC;
+  std::unique_ptr<raw_fd_ostream> File(
+      new raw_fd_ostream(Path, EC, sys::fs::OF_Text));
+  if (EC) {
+    errs() << "error: cannot open " << Path << ": " << EC.message() << "\n";
+    return nullptr;
+  }
+  File->SetBufferSize(ReportBufferSize);
+  std::unique_ptr<Reporter> R(new Reporter(*File, ReportFormat, ToolName));
+  R->Owned = std::move(File);
+  return R;
+}
+
+void Reporter::report(const Finding &F) {
+  if (Fmt == JSONL) {
+    OS << "{\"rule\": ";
+    writeString(OS, F.Rule);
+    OS << ", \"file\": ";
+    writeString(OS, F.File);
+    OS << ", \"line\": " << F.Line << ", \"column\": " << F.Column
+       << ", \"function\": ";
+    writeString(OS, F.Function);
+    OS << ", \"state\": ";
+    writeString(OS, F.State);
+    OS << "}\n";
+    ++Count;
+    return;
+  }
+
+  OS << (Count++ ? ",\n" : "\n") << "      {\"ruleId\": ";
+  writeString(OS, F.Rule);
+  OS << ", \"level\": \"warning\", \"message\": {\"text\": ";
+  writeString(OS, F.Message + " (" + F.State + ")");
+  OS << "}, \"locations\": [{\"physicalLocation\": {\"artifactLocation\": ";
+  writeArtifactLocation(OS, F.File);
+  if (F.Line) {
+    OS << ", \"region\": {\"startLine\": " << F.Line;
+    if (F.Column)
+      OS << ", \"startColumn\": " << F.Column;
+    OS << "}";
+  }
+  OS << "}, \"logicalLocations\": [{\"name\": ";
+  writeString(OS, F.Function);
+  OS << ", \"kind\": \"function\"}]}], \"properties\": {\"divisorState\": ";
+  writeString(OS, F.State);
+  OS << "}}";
+}
+
+void Reporter::finish() {
+  if (Finished)
+    return;
+  Finished = true;
+  if (Fmt == SARIF)
+    OS << (Count ? "\n    " : "") << "]\n  }]\n}\n";
+  OS.flush();
+}
+} // namespace dataflow
@@ -0,0 +1,279 @@
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include <random>
+#include <string>
+#include <vector>
+
+#include "BlockPatch.h"
+#include "DivZeroAnalysis.h"
+
+using namespace llvm;
+using namespace dataflow;
+
+//===----------------------------------------------------------------------===//
+// Incremental re-solve check
+//
+// Applies random edits to one block of every function at a time, patches
+// them in with patchChangedBlocks() as DivZeroServer does, and checks that
+// reanalyze() ends with exactly the states and findings a fresh analyze()
+// of the edited function gives. Prints one line per file; exits with 1 on
+// the first mismatch.
+//===----------------------------------------------------------------------===//
+
+static cl::list<std::string> InputPaths(cl::Positional, cl::OneOrMore,
+                                        cl::desc("<.bc/.ll files>"));
+
+static cl::opt<unsigned> Edits("edits", cl::init(50),
+                               cl::desc("Edits per function"));
+
+static cl::opt<unsigned> Seed("seed", cl::init(1),
+                              cl::desc("Seed of the edit generator"));
+
+namespace {
+/// The analyses a solve reads, built for the current body of F.
+struct FunctionInfo {
+  FunctionInfo(Function &F, TargetLibraryInfoImpl &TLII)
+      : PA(F), DT(F), LI(DT), AC(F), TLI(TLII, &F), SE(F, TLI, AC, DT, LI) {}
+
+  PointerAnalysis PA;
+  DominatorTree DT;
+  LoopInfo LI;
+  AssumptionCache AC;
+  TargetLibraryInfo TLI;
+  ScalarEvolution SE;
+};
+} // namespace
+
+template <typename T> static T *pick(std::vector<T *> &Items,
+                                     std::mt19937 &Rng) {
+  if (Items.empty())
+    return nullptr;
+  return Items[Rng() % Items.size()];
+}
+
+/**
+ * Make one random edit to a random block of F: change an integer constant,
+ * erase a store, or add a division, an integer store, a load feeding a
+ * division or a pointer store. Returns false if the chosen edit does not
+ * apply to F.
+ */
+static bool applyEdit(Function &F, std::mt19937 &Rng) {
+  std::vector<BasicBlock *> Blocks;
+  std::vector<AllocaInst *> IntSlots, PtrSlots;
+  for (BasicBlock &BB : F) {
+    Blocks.push_back(&BB);
+    for (Instruction &I : BB) {
+      if (auto *AI = dyn_cast<AllocaInst>(&I)) {
+        if (&BB != &F.getEntryBlock())
+          continue;
+        if (AI->getAllocatedType()->isIntegerTy())
+          IntSlots.push_back(AI);
+        else if (AI->getAllocatedType()->isPointerTy())
+          PtrSlots.push_back(AI);
+      }
+    }
+  }
+  BasicBlock *BB = pick(Blocks, Rng);
+  IRBuilder<> B(BB->getTerminator());
+  auto Const = [&](Type *Ty) {
+    static const int Values[] = {0, 1, 3, -1};
+    return ConstantInt::get(Ty, Values[Rng() % 4], true);
+  };
+
+  switch (Rng() % 6) {
+  case 0: {
+    std::vector<Use *> Uses;
+    for (Instruction &I : *BB) {
+      if (!isa<BinaryOperator>(I) && !isa<ICmpInst>(I) && !isa<StoreInst>(I))
+        continue;
+      for (Use &U : I.operands()) {
+        if (isa<ConstantInt>(U.get()))
+          Uses.push_back(&U);
+      }
+    }
+    Use *U = pick(Uses, Rng);
+    if (!U)
+      return false;
+    U->set(Const(U->get()->getType()));
+    return true;
+  }
+  case 1: {
+    std::vector<StoreInst *> Stores;
+    for (Instruction &I : *BB) {
+      if (auto *SI = dyn_cast<StoreInst>(&I))
+        Stores.push_back(SI);
+    }
+    StoreInst *SI = pick(Stores, Rng);
+    if (!SI)
+      return false;
+    SI->eraseFromParent();
+    return true;
+  }
+  case 2: {
+    std::vector<Value *> Ints;
+    for (Argument &Arg : F.args()) {
+      if (Arg.getType()->isIntegerTy())
+        Ints.push_back(&Arg);
+    }
+    for (Instruction &I : *BB) {
+      if (I.getType()->isIntegerTy() && !I.isTerminator())
+        Ints.push_back(&I);
+    }
+    Value *V = pick(Ints, Rng);
+    if (!V)
+      return false;
+    B.CreateSDiv(ConstantInt::get(V->getType(), 10), V);
+    return true;
+  }
+  case 3: {
+    AllocaInst *Slot = pick(IntSlots, Rng);
+    if (!Slot)
+      return false;
+    B.CreateStore(Const(Slot->getAllocatedType()), Slot);
+    return true;
+  }
+  case 4: {
+    AllocaInst *Slot = pick(IntSlots, Rng);
+    if (!Slot)
+      return false;
+    Type *Ty = Slot->getAllocatedType();
+    B.CreateSDiv(ConstantInt::get(Ty, 1), B.CreateLoad(Ty, Slot));
+    return true;
+  }
+  default: {
+    AllocaInst *Slot = pick(PtrSlots, Rng);
+    if (!Slot)
+      return false;
+    std::vector<AllocaInst *> Targets;
+    for (AllocaInst *AI : IntSlots) {
+      if (AI->getType() == Slot->getAllocatedType())
+        Targets.push_back(AI);
+    }
+    AllocaInst *Target = pick(Targets, Rng);
+    if (!Target)
+      return false;
+    B.CreateStore(Target, Slot);
+    return true;
+  }
+  }
+}
+
+/// Every state and finding of DZ, one instruction per line.
+static std::string dump(Function &F, DivZeroAnalysis &DZ) {
+  std::string Text;
+  raw_string_ostream OS(Text);
+  auto Print = [&](const char *Name, StateMap &Map, Instruction *I) {
+    auto It = Map.find(I);
+    OS << "  " << Name << ":";
+    if (It == Map.end())
+      return;
+    for (auto &Entry : *It->second)
+      OS << " " << Entry.first << "=" << stateName(Entry.second);
+  };
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    OS << *I << (DZ.ErrorInsts.count(&*I) ? "  ; finding\n" : "\n");
+    Print("in", DZ.InMap, &*I);
+    Print("\n  out", DZ.OutMap, &*I);
+    OS << "\n";
+  }
+  return OS.str();
+}
+
+/// Report the first line where Expected and Actual differ.
+static void printMismatch(StringRef Expected, StringRef Actual) {
+  SmallVector<StringRef, 64> ELines, ALines;
+  Expected.split(ELines, '\n');
+  Actual.split(ALines, '\n');
+  for (size_t Idx = 0; Idx < std::max(ELines.size(), ALines.size()); ++Idx) {
+    StringRef E = Idx < ELines.size() ? ELines[Idx] : "<end>";
+    StringRef A = Idx < ALines.size() ? ALines[Idx] : "<end>";
+    if (E != A) {
+      errs() << "  analyze:   " << E << "\n  reanalyze: " << A << "\n";
+      return;
+    }
+  }
+}
+
+/// Edit every function of Path and compare; false on the first mismatch.
+static bool checkFile(const std::string &Path, std::mt19937 &Rng) {
+  LLVMContext Ctx;
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = parseIRFile(Path, Err, Ctx);
+  if (!M) {
+    Err.print("DivZeroReanalyzeCheck", errs());
+    return false;
+  }
+  TargetLibraryInfoImpl TLII(Triple(M->getTargetTriple()));
+
+  std::vector<Function *> Functions;
+  for (Function &F : *M) {
+    if (!F.isDeclaration())
+      Functions.push_back(&F);
+  }
+
+  unsigned Applied = 0;
+  for (Function *F : Functions) {
+    DivZeroAnalysis Incremental;
+    {
+      FunctionInfo Info(*F, TLII);
+      Incremental.analyze(*F, &Info.PA, &Info.SE);
+    }
+    for (unsigned Edit = 0; Edit < Edits; ++Edit) {
+      ValueToValueMapTy VMap;
+      Function *Copy = CloneFunction(F, VMap);
+      bool Edited = applyEdit(*Copy, Rng);
+      SmallVector<BasicBlock *, 8> Changed;
+      if (Edited && !patchChangedBlocks(*F, *Copy, Changed)) {
+        errs() << Path << ": " << F->getName() << ": cannot patch edit "
+               << Edit << "\n";
+        return false;
+      }
+      Copy->eraseFromParent();
+      if (!Edited)
+        continue;
+      ++Applied;
+      if (verifyFunction(*F, &errs()))
+        return false;
+
+      FunctionInfo Info(*F, TLII);
+      Incremental.reanalyze(*F, &Info.PA, Changed, &Info.SE);
+      DivZeroAnalysis Fresh;
+      FunctionInfo FreshInfo(*F, TLII);
+      Fresh.analyze(*F, &FreshInfo.PA, &FreshInfo.SE);
+
+      std::string Expected = dump(*F, Fresh), Actual = dump(*F, Incremental);
+      if (Expected != Actual) {
+        errs() << Path << ": " << F->getName() << ": edit " << Edit
+               << " differs\n";
+        printMismatch(Expected, Actual);
+        return false;
+      }
+    }
+  }
+  outs() << Path << ": " << Applied << " edits, same states\n";
+  return true;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "Check DivZero reanalyze() against analyze()\n");
+  std::mt19937 Rng(Seed);
+  for (const std::string &Path : InputPaths) {
+    if (!checkFile(Path, Rng))
+      return 1;
+  }
+  return 0;
+}
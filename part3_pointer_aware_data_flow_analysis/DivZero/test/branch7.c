@@ -0,0 +1,13 @@
+int f(int n) {
+  int debug = 0;
+  int scale = 0;
+  if (debug) {
+    n = n / scale; // never runs
+  }
+  if (scale == 0) {
+    scale = 1;
+  }
+  return n / scale; // scale is 1 on the only feasible path
+}
+// OUTPUT: Running DivZero on f
+// OUTPUT: Potential Instructions by DivZero:
@@ -0,0 +1,10 @@
+int f(int n) {
+  int sum = 0;
+  for (int i = 1; i <= n; i++) {
+    sum += 100 / i;
+  }
+  return sum;
+}
+// i starts at 1 and only grows, so 100 / i is never flagged.
+// OUTPUT: Running DivZero on f
+// OUTPUT: Potential Instructions by DivZero:
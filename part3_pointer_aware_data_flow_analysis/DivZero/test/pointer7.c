@@ -0,0 +1,10 @@
+int f(int *a, int *b) {
+  *a = 0;
+  *b = 1;
+  return 1 / *a; // main passes the same cell twice, so *a is 1
+}
+
+int main() {
+  int x;
+  return f(&x, &x);
+}
@@ -0,0 +1,8 @@
+int f(int n) {
+  int a = 0;
+  int b = n % 2;
+  int c = n / a;  // divide by zero
+  int d = n % a;  // remainder by zero
+  int e = n % b;  // remainder by maybe zero
+  return c + d + e;
+}
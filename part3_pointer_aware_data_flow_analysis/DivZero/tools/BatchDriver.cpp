@@ -0,0 +1,281 @@
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "DivZeroAnalysis.h"
+#include "DivZeroQuery.h"
+#include "Reporter.h"
+
+using namespace llvm;
+using namespace dataflow;
+
+//===----------------------------------------------------------------------===//
+// Standalone batch driver
+//
+// Analyses many bitcode/IR files in one process instead of paying for an
+// `opt -load` start-up per translation unit. Each file gets its own
+// LLVMContext so files are analysed concurrently. Each file's report is
+// written, in input order, as soon as it and every file before it are done.
+//===----------------------------------------------------------------------===//
+
+static cl::list<std::string> InputPaths(cl::Positional, cl::OneOrMore,
+                                        cl::desc("<.bc/.ll files or dirs>"));
+
+static cl::opt<std::string> OutputPath("o", cl::init("-"),
+                                       cl::desc("Merged report file ('-' for "
+                                                "stdout, or stderr when "
+                                                "-divzero-report=-)"),
+                                       cl::value_desc("filename"));
+
+static cl::opt<unsigned> Jobs("j", cl::init(0),
+                              cl::desc("Number of worker threads "
+                                       "(0 = all hardware threads)"));
+
+static cl::opt<bool> Demand("demand",
+                            cl::desc("Answer each division with a "
+                                     "demand-driven query instead of solving "
+                                     "whole functions"));
+
+static cl::opt<unsigned> QueryLine("query-line", cl::init(0),
+                                   cl::desc("Only check divisions at this "
+                                            "source line (implies -demand)"),
+                                   cl::value_desc("line"));
+
+static bool isIRFile(StringRef Path) {
+  StringRef Ext = sys::path::extension(Path);
+  return Ext == ".bc" || Ext == ".ll";
+}
+
+/**
+ * Expand directories into the .bc/.ll files below them. Files named on the
+ * command line are taken as-is whatever their extension.
+ */
+static bool collectInputs(std::vector<std::string> &Files) {
+  for (const std::string &Path : InputPaths) {
+    if (!sys::fs::is_directory(Path)) {
+      Files.push_back(Path);
+      continue;
+    }
+    std::vector<std::string> Found;
+    std::error_code EC;
+    for (sys::fs::recursive_directory_iterator It(Path, EC), End;
+         It != End && !EC; It.increment(EC)) {
+      if (isIRFile(It->path()) && !sys::fs::is_directory(It->path()))
+        Found.push_back(It->path());
+    }
+    if (EC) {
+      errs() << "error: cannot read directory " << Path << ": "
+             << EC.message() << "\n";
+      return false;
+    }
+    std::sort(Found.begin(), Found.end());
+    Files.insert(Files.end(), Found.begin(), Found.end());
+  }
+  return true;
+}
+
+/**
+ * Analyse one materialised function, appending its part of the report to OS
+ * and, if Findings is set, its findings for the structured report. Points-to
+ * facts come from MPA if it is set.
+ */
+static void analyzeFunction(Function &F, DivZeroAnalysis &DZ,
+                            std::vector<std::unique_ptr<Checker>> &Checkers,
+                            TargetLibraryInfoImpl &TLII,
+                            const ModulePointerAnalysis *MPA, raw_ostream &OS,
+                            std::vector<Finding> *Findings) {
+  OS << "Running " << DZ.getAnalysisName() << " on " << F.getName() << "\n";
+  PointerAnalysis PA = MPA ? MPA->getFunctionView(F) : PointerAnalysis(F);
+  DominatorTree DT(F);
+  LoopInfo LI(DT);
+  AssumptionCache AC(F);
+  TargetLibraryInfo TLI(TLII, &F);
+  ScalarEvolution SE(F, TLI, AC, DT, LI);
+  OS << "Potential Instructions by " << DZ.getAnalysisName() << ": \n";
+  if (Demand || QueryLine) {
+    DivZeroQuery Query(F, PA, &SE);
+    for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+      const DebugLoc &Loc = I->getDebugLoc();
+      if (QueryLine && (!Loc || Loc.getLine() != QueryLine))
+        continue;
+      for (auto &C : Checkers) {
+        Value *V = C->getCheckedValue(&*I);
+        if (!V)
+          continue;
+        if (!Query.isReachable(I->getParent()))
+          break;
+        Domain *State = Query.getValueState(V);
+        if (!C->check(&*I, State))
+          continue;
+        OS << *I << "\n";
+        if (Findings)
+          Findings->emplace_back(&*I, State, C->getName(), C->getMessage());
+        break;
+      }
+    }
+    return;
+  }
+  DZ.analyze(F, &PA, &SE);
+  for (auto I : DZ.ErrorInsts) {
+    OS << *I << "\n";
+    if (Findings)
+      Findings->emplace_back(I, DZ.getFindingState(I), DZ.getFindingRule(I),
+                             DZ.getFindingMessage(I));
+  }
+  DZ.releaseMemory();
+}
+
+namespace {
+/// The text report and findings of one analysed file.
+struct FileResult {
+  std::string Text;
+  std::vector<Finding> Findings;
+  /// The file did not parse, or some function of it could not be read.
+  bool Failed = false;
+};
+} // namespace
+
+/**
+ * Analyse every function defined in Path into Result. For bitcode, function
+ * bodies are materialised one at a time from the lazily loaded module and
+ * freed again once analysed, so peak memory follows the largest function
+ * rather than the whole module. Textual .ll files are always parsed whole,
+ * and with -divzero-module-pta every body is materialised up front and kept,
+ * so in either case peak memory follows the module. If Structured is set,
+ * the findings are also collected for the structured report; they do not
+ * refer to the IR. Errors are reported in the text and mark the result as
+ * failed.
+ */
+static void analyzeFile(const std::string &Path, bool Structured,
+                        FileResult &Result) {
+  raw_string_ostream OS(Result.Text);
+  std::vector<Finding> *Findings = Structured ? &Result.Findings : nullptr;
+  OS << "== " << Path << "\n";
+
+  LLVMContext Ctx;
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = getLazyIRFileModule(Path, Err, Ctx);
+  if (!M) {
+    Err.print("DivZeroBatch", OS);
+    Result.Failed = true;
+    return;
+  }
+
+  DivZeroAnalysis DZ;
+  std::vector<std::unique_ptr<Checker>> Checkers = createEnabledCheckers();
+  TargetLibraryInfoImpl TLII(Triple(M->getTargetTriple()));
+  std::unique_ptr<ModulePointerAnalysis> MPA;
+  if (useModulePointerAnalysis()) {
+    if (Error E = M->materializeAll()) {
+      OS << "error: " << toString(std::move(E)) << "\n";
+      Result.Failed = true;
+      return;
+    }
+    MPA.reset(new ModulePointerAnalysis(*M));
+  }
+  for (Function &F : *M) {
+    if (F.isDeclaration())
+      continue;
+    if (Error E = F.materialize()) {
+      OS << "error: " << toString(std::move(E)) << "\n";
+      Result.Failed = true;
+      continue;
+    }
+    analyzeFunction(F, DZ, Checkers, TLII, MPA.get(), OS, Findings);
+    if (!MPA)
+      F.deleteBody();
+  }
+}
+
+namespace {
+/**
+ * Writes per-file results in input order as the files finish. A result that
+ * arrives early is held until every file before it has been written, and is
+ * freed once written, so only the out-of-order window is kept in memory.
+ */
+class OrderedWriter {
+public:
+  OrderedWriter(raw_ostream &Out, Reporter *Report)
+      : Out(Out), Report(Report) {}
+
+  void done(size_t Idx, FileResult Result) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    Pending.emplace(Idx, std::move(Result));
+    for (auto It = Pending.begin(); It != Pending.end() && It->first == Next;
+         It = Pending.erase(It), ++Next) {
+      Out << It->second.Text;
+      Failed |= It->second.Failed;
+      if (Report) {
+        for (const Finding &F : It->second.Findings)
+          Report->report(F);
+      }
+    }
+  }
+
+  /// Whether a file written so far failed to load.
+  bool failed() const { return Failed; }
+
+private:
+  raw_ostream &Out;
+  Reporter *Report;
+  std::mutex Mutex;
+  std::map<size_t, FileResult> Pending;
+  size_t Next = 0;
+  bool Failed = false;
+};
+} // namespace
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "Batch divide-by-zero analysis\n");
+
+  std::vector<std::string> Files;
+  if (!collectInputs(Files))
+    return 1;
+
+  // The structured report owns stdout if it asks for it; the text report
+  // then goes to stderr so that stdout stays valid JSON.
+  std::unique_ptr<raw_fd_ostream> OutFile;
+  raw_ostream *Out = &errs();
+  if (OutputPath != "-" || !Reporter::writesToStdout()) {
+    std::error_code EC;
+    OutFile.reset(new raw_fd_ostream(OutputPath, EC, sys::fs::OF_Text));
+    if (EC) {
+      errs() << "error: cannot open " << OutputPath << ": " << EC.message()
+             << "\n";
+      return 1;
+    }
+    Out = OutFile.get();
+  }
+
+  std::unique_ptr<Reporter> Report = Reporter::createFromOptions("DivZero");
+
+  OrderedWriter Writer(*Out, Report.get());
+  ThreadPool Pool(hardware_concurrency(Jobs));
+  bool Structured = Report != nullptr;
+  for (size_t Idx = 0; Idx < Files.size(); ++Idx)
+    Pool.async([&Files, &Writer, Structured, Idx] {
+      FileResult Result;
+      analyzeFile(Files[Idx], Structured, Result);
+      Writer.done(Idx, std::move(Result));
+    });
+  Pool.wait();
+  // Scripts must be able to tell a batch that skipped code from a clean one.
+  return Writer.failed() ? 1 : 0;
+}
@@ -0,0 +1,382 @@
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ValueSymbolTable.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "BlockPatch.h"
+#include "DivZeroAnalysis.h"
+#include "DivZeroQuery.h"
+#include "Reporter.h"
+
+using namespace llvm;
+using namespace dataflow;
+
+//===----------------------------------------------------------------------===//
+// Analysis server
+//
+// Keeps one module and the analysis results of its functions in memory and
+// answers queries over a Unix domain socket, so an editor does not pay for
+// parsing and solving on every request. Results are computed on first use
+// and cached per function; `update` links new bodies over the old ones and
+// only drops what was cached for the functions it replaced.
+//
+// One request per line; every response ends with a line holding a single
+// ".":
+//
+//   verdicts <function>          one line per checked division
+//   state <function> <line>      abstract state before that source line
+//   alias <function> <pointer>   pointers that may alias %<pointer>
+//   update <file>                replace the functions defined in file
+//   quit                         close this connection
+//   shutdown                     stop the server
+//===----------------------------------------------------------------------===//
+
+static cl::opt<std::string> InputPath(cl::Positional, cl::Required,
+                                      cl::desc("<.bc/.ll module>"));
+
+static cl::opt<std::string> SocketPath("socket", cl::init("divzero.sock"),
+                                       cl::desc("Unix domain socket to listen "
+                                                "on"),
+                                       cl::value_desc("path"));
+
+namespace {
+
+class Server {
+public:
+  Server() : Checkers(createEnabledCheckers()) {
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+    FAM.registerPass([] { return PointerAnalysisPass(); });
+    FAM.registerPass([] { return DivZeroAnalysisPass(); });
+    FAM.registerPass([] { return DivZeroQueryAnalysis(); });
+    MAM.registerPass([] { return ModulePointerAnalysisPass(); });
+  }
+
+  bool load(StringRef Path, raw_ostream &OS);
+
+  /// Run one request and write its response; false once shut down.
+  bool handle(StringRef Request, raw_ostream &OS);
+
+private:
+  Function *getFunction(StringRef Name, raw_ostream &OS);
+  void verdicts(Function &F, raw_ostream &OS);
+  void state(Function &F, unsigned Line, raw_ostream &OS);
+  void alias(Function &F, StringRef Name, raw_ostream &OS);
+  void update(StringRef Path, raw_ostream &OS);
+
+  LLVMContext Ctx;
+  std::unique_ptr<Module> M;
+  std::vector<std::unique_ptr<Checker>> Checkers;
+
+  PassBuilder PB;
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+};
+} // namespace
+
+bool Server::load(StringRef Path, raw_ostream &OS) {
+  SMDiagnostic Err;
+  M = parseIRFile(Path, Err, Ctx);
+  if (!M) {
+    Err.print("DivZeroServer", OS);
+    return false;
+  }
+  return true;
+}
+
+Function *Server::getFunction(StringRef Name, raw_ostream &OS) {
+  Function *F = M->getFunction(Name);
+  if (!F || F->isDeclaration()) {
+    OS << "error: no function named " << Name << "\n";
+    return nullptr;
+  }
+  // Function analyses only see module results that are already cached.
+  if (useModulePointerAnalysis())
+    MAM.getResult<ModulePointerAnalysisPass>(*M);
+  return F;
+}
+
+/**
+ * Verdict of every checked instruction in F, answered by the demand-driven
+ * query so only what the divisors depend on is solved.
+ */
+void Server::verdicts(Function &F, raw_ostream &OS) {
+  DivZeroQuery &Query = FAM.getResult<DivZeroQueryAnalysis>(F);
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    for (auto &C : Checkers) {
+      Value *V = C->getCheckedValue(&*I);
+      if (!V)
+        continue;
+      Domain *State = nullptr;
+      const char *Verdict = "unreachable";
+      if (Query.isReachable(I->getParent())) {
+        State = Query.getValueState(V);
+        Verdict = C->check(&*I, State) ? "warning" : "ok";
+      }
+      Finding Found(&*I, State, C->getName(), C->getMessage());
+      OS << Verdict << " " << Found.Line << ":" << Found.Column << " "
+         << Found.Rule << " " << Found.State << "\n";
+      break;
+    }
+  }
+}
+
+/// The state DivZeroAnalysis solved right before the first instruction of
+/// Line.
+void Server::state(Function &F, unsigned Line, raw_ostream &OS) {
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    const DebugLoc &Loc = I->getDebugLoc();
+    if (!Loc || Loc.getLine() != Line)
+      continue;
+    auto &Result = FAM.getResult<DivZeroAnalysisPass>(F);
+    if (const Memory *In = Result.getInState(&*I)) {
+      for (auto &Entry : *In)
+        OS << stateName(Entry.second) << "\t" << Entry.first << "\n";
+    }
+    return;
+  }
+  OS << "error: no instruction at line " << Line << "\n";
+}
+
+void Server::alias(Function &F, StringRef Name, raw_ostream &OS) {
+  Value *P = F.getValueSymbolTable()->lookup(Name.ltrim('%'));
+  if (!P || !P->getType()->isPointerTy()) {
+    OS << "error: no pointer named " << Name << "\n";
+    return;
+  }
+  PointerAnalysis &PA = FAM.getResult<PointerAnalysisPass>(F);
+  std::string PName = variable(P);
+  auto Print = [&](Value *Q) {
+    std::string QName = variable(Q);
+    if (Q != P && PA.alias(PName, QName))
+      OS << QName << "\n";
+  };
+  for (Argument &Arg : F.args()) {
+    if (Arg.getType()->isPointerTy())
+      Print(&Arg);
+  }
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    if (I->getType()->isPointerTy())
+      Print(&*I);
+  }
+}
+
+/**
+ * Link the functions defined in Path over the module's. Only the functions
+ * it defines lose their cached results; the analyses are intraprocedural,
+ * so nothing else can have changed. A function whose solved states are
+ * cached keeps the blocks the update leaves as they were, and its states are
+ * re-solved from the edited blocks on. Module-wide points-to facts depend on
+ * every body, so with -divzero-module-pta all results are dropped.
+ */
+void Server::update(StringRef Path, raw_ostream &OS) {
+  SMDiagnostic Err;
+  std::unique_ptr<Module> Src = parseIRFile(Path, Err, Ctx);
+  if (!Src) {
+    Err.print("DivZeroServer", OS);
+    return;
+  }
+
+  // Functions to patch in place, linked in under a temporary name.
+  // Functions to patch in place, with the linkage the file gave them.
+  struct PatchedFunction {
+    Function *Old;
+    std::string Name;
+    GlobalValue::LinkageTypes Linkage;
+  };
+  std::vector<PatchedFunction> Patched;
+  unsigned Changed = 0;
+  for (Function &NewF : *Src) {
+    if (NewF.isDeclaration())
+      continue;
+    ++Changed;
+    Function *Old = M->getFunction(NewF.getName());
+    if (!Old)
+      continue;
+    if (!useModulePointerAnalysis() &&
+        FAM.getCachedResult<DivZeroAnalysisPass>(*Old) &&
+        Old->getFunctionType() == NewF.getFunctionType()) {
+      // Linked even if nothing in the file refers to it.
+      GlobalValue::LinkageTypes Linkage = NewF.getLinkage();
+      NewF.setLinkage(GlobalValue::ExternalLinkage);
+      NewF.setName(NewF.getName() + ".divzero.update");
+      Patched.push_back({Old, NewF.getName().str(), Linkage});
+      continue;
+    }
+    FAM.clear(*Old, Old->getName());
+  }
+  if (useModulePointerAnalysis()) {
+    FAM.clear();
+    MAM.clear();
+  }
+  if (Linker::linkModules(*M, std::move(Src), Linker::OverrideFromSrc)) {
+    OS << "error: cannot link " << Path << "\n";
+    return;
+  }
+
+  for (PatchedFunction &Entry : Patched) {
+    Function *Old = Entry.Old;
+    Function *New = M->getFunction(Entry.Name);
+    SmallVector<BasicBlock *, 8> Edited;
+    if (!patchChangedBlocks(*Old, *New, Edited)) {
+      FAM.clear(*Old, Old->getName());
+      Old->dropAllReferences();
+      Old->getBasicBlockList().splice(Old->end(), New->getBasicBlockList());
+      for (unsigned Idx = 0; Idx < Old->arg_size(); ++Idx)
+        New->getArg(Idx)->replaceAllUsesWith(Old->getArg(Idx));
+      // Old takes New's place entirely, so it also takes its attributes,
+      // linkage and metadata.
+      Old->copyAttributesFrom(New);
+      Old->setLinkage(Entry.Linkage);
+      Old->clearMetadata();
+      Old->copyMetadata(New, 0);
+    } else {
+      // Keep the solved states, drop everything else computed for Old.
+      PreservedAnalyses PA = PreservedAnalyses::none();
+      PA.preserve<DivZeroAnalysisPass>();
+      FAM.invalidate(*Old, PA);
+      FAM.getCachedResult<DivZeroAnalysisPass>(*Old)->reanalyze(
+          *Old, FAM.getResult<PointerAnalysisPass>(*Old), Edited,
+          &FAM.getResult<ScalarEvolutionAnalysis>(*Old));
+    }
+    New->replaceAllUsesWith(Old);
+    New->eraseFromParent();
+  }
+  OS << "updated " << Changed << " function(s)\n";
+}
+
+bool Server::handle(StringRef Request, raw_ostream &OS) {
+  SmallVector<StringRef, 3> Args;
+  SplitString(Request, Args);
+  if (Args.empty())
+    return true;
+
+  StringRef Cmd = Args[0];
+  unsigned Line;
+  if (Cmd == "shutdown")
+    return false;
+  if (Cmd == "update" && Args.size() == 2) {
+    update(Args[1], OS);
+  } else if (Cmd == "verdicts" && Args.size() == 2) {
+    if (Function *F = getFunction(Args[1], OS))
+      verdicts(*F, OS);
+  } else if (Cmd == "state" && Args.size() == 3 &&
+             !Args[2].getAsInteger(10, Line)) {
+    if (Function *F = getFunction(Args[1], OS))
+      state(*F, Line, OS);
+  } else if (Cmd == "alias" && Args.size() == 3) {
+    if (Function *F = getFunction(Args[1], OS))
+      alias(*F, Args[2], OS);
+  } else {
+    OS << "error: bad request: " << Request << "\n";
+  }
+  return true;
+}
+
+static bool sendAll(int FD, StringRef Data) {
+  while (!Data.empty()) {
+    ssize_t N = ::write(FD, Data.data(), Data.size());
+    if (N < 0 && errno == EINTR)
+      continue;
+    if (N <= 0)
+      return false;
+    Data = Data.drop_front(N);
+  }
+  return true;
+}
+
+/**
+ * Serve one client until it disconnects or sends quit. Returns false once a
+ * client asked for shutdown.
+ */
+static bool serveClient(Server &S, int FD) {
+  std::string Pending;
+  char Buf[4096];
+  while (true) {
+    size_t EOL;
+    while ((EOL = Pending.find('\n')) != std::string::npos) {
+      std::string Request = Pending.substr(0, EOL);
+      Pending.erase(0, EOL + 1);
+      StringRef Trimmed = StringRef(Request).trim();
+      if (Trimmed == "quit")
+        return true;
+
+      std::string Response;
+      raw_string_ostream OS(Response);
+      bool Running = S.handle(Trimmed, OS);
+      OS << ".\n";
+      if (!sendAll(FD, OS.str()) || !Running)
+        return Running;
+    }
+
+    ssize_t N = ::read(FD, Buf, sizeof(Buf));
+    if (N < 0 && errno == EINTR)
+      continue;
+    if (N <= 0)
+      return true;
+    Pending.append(Buf, N);
+  }
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "Divide-by-zero analysis server\n");
+
+  Server S;
+  if (!S.load(InputPath, errs()))
+    return 1;
+
+  sockaddr_un Addr = {};
+  Addr.sun_family = AF_UNIX;
+  if (SocketPath.size() >= sizeof(Addr.sun_path)) {
+    errs() << "error: socket path too long: " << SocketPath << "\n";
+    return 1;
+  }
+  strcpy(Addr.sun_path, SocketPath.c_str());
+
+  int Listen = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  ::unlink(SocketPath.c_str());
+  if (Listen < 0 ||
+      ::bind(Listen, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) < 0 ||
+      ::listen(Listen, 4) < 0) {
+    errs() << "error: cannot listen on " << SocketPath << ": "
+           << strerror(errno) << "\n";
+    return 1;
+  }
+  // A client going away mid-response must not take the server down.
+  signal(SIGPIPE, SIG_IGN);
+
+  bool Running = true;
+  while (Running) {
+    int Client = ::accept(Listen, nullptr, nullptr);
+    if (Client < 0) {
+      if (errno == EINTR)
+        continue;
+      errs() << "error: accept: " << strerror(errno) << "\n";
+      break;
+    }
+    Running = serveClient(S, Client);
+    ::close(Client);
+  }
+  ::close(Listen);
+  ::unlink(SocketPath.c_str());
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+
+namespace instrument {
+
+/// Granularity of the coverage probes, selected with -coverage-mode.
+enum class CoverageMode { Instruction, Function, Block, Edge, Bitmap };
+
+CoverageMode getCoverageMode();
+
+/**
+ * Instrument M for fuzzing rather than counting: every block of a defined
+ * function records the edge it was entered through in the runtime's AFL
+ * bitmap, hashed AFL's way from a random ID of the block and of the block
+ * before it. A constructor attaches the bitmap to the fuzzer and starts the
+ * fork server. Returns whether any probe was inserted.
+ */
+bool insertBitmapProbes(Module &M);
+
+/// One term of the count of a site: Coef times a counter of the plan.
+struct CoverageTerm {
+  unsigned Counter;
+  int64_t Coef;
+};
+
+typedef std::vector<CoverageTerm> CoverageExpr;
+
+/**
+ * Where the coverage probes of one function go and how the count of each of
+ * its sites follows from the counters they bump.
+ *
+ * In block and edge mode the function is seen as a flow graph whose nodes
+ * are straight-line segments: blocks, further split after every call,
+ * divisor checks included, since those may never come back. Block mode
+ * probes every segment whose count is not simply that of the single segment
+ * falling into it. Edge mode only probes the edges off a spanning tree of
+ * the graph (Knuth's placement); the counts of the tree edges, and from them
+ * of every segment, are sums of the probed ones by flow conservation. Every
+ * site is given its count as such a sum, for the runtime to evaluate once at
+ * exit.
+ *
+ * The plan is made before any probe is inserted, so that the sites of all
+ * functions can be collected from uninstrumented code.
+ */
+class CoveragePlan {
+public:
+  CoveragePlan(Function &F, CoverageMode Mode);
+
+  unsigned getNumCounters() const { return Probes.size(); }
+
+  /// Sites of the function, each with the index of its count in getExprs().
+  ArrayRef<std::pair<Instruction *, unsigned>> getSites() const {
+    return Sites;
+  }
+  ArrayRef<CoverageExpr> getExprs() const { return Exprs; }
+
+  /// Insert the probes, counter i of the plan being element First + i of
+  /// Counters. Critical edges get split on the way.
+  void insertProbes(GlobalVariable *Counters, unsigned First);
+
+private:
+  /// A probe goes right before Point, or on the edge from Term to its
+  /// successor Succ if Point is null.
+  struct Probe {
+    Instruction *Point;
+    Instruction *Term;
+    unsigned Succ;
+  };
+
+  void planInstructions(Function &F);
+  void planFlow(Function &F, CoverageMode Mode);
+
+  std::vector<Probe> Probes;
+  std::vector<std::pair<Instruction *, unsigned>> Sites;
+  std::vector<CoverageExpr> Exprs;
+};
+
+} // namespace instrument
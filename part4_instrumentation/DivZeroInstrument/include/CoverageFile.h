@@ -0,0 +1,45 @@
+#ifndef COVERAGE_FILE_H
+#define COVERAGE_FILE_H
+
+#include <stdint.h>
+
+/*
+ * Binary coverage file, <exe>.covb.
+ *
+ * Shared by the runtime, which creates it and adds each run's counts to it
+ * in place through mmap, and by DivZeroCovMerge. Its size only depends on
+ * the number of coverage sites of the binary:
+ *
+ *   struct CovFileHeader   header
+ *   uint64_t               counts[NumSites]
+ *   struct CovFileLoc      locs[NumSites]
+ *
+ * Hash identifies the instrumentation the counts belong to; files with
+ * different hashes cannot be merged. All fields are in the byte order of
+ * the machine that wrote the file, so the counts can be updated in place;
+ * a file from a machine of the other byte order fails the magic check and
+ * is not read.
+ */
+
+#define COV_FILE_MAGIC 0x42564f435a44ULL /* "DZCOVB" */
+#define COV_FILE_VERSION 1
+
+struct CovFileHeader {
+  uint64_t Magic;
+  uint32_t Version;
+  uint32_t Reserved;
+  uint64_t Hash;
+  uint64_t NumSites;
+};
+
+struct CovFileLoc {
+  int32_t Line;
+  int32_t Col;
+};
+
+static inline uint64_t covFileSize(uint64_t numSites) {
+  return sizeof(struct CovFileHeader) +
+         numSites * (sizeof(uint64_t) + sizeof(struct CovFileLoc));
+}
+
+#endif
@@ -3,18 +3,34 @@
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
 
 using namespace llvm;
 
 namespace instrument {
 
-struct Instrument : public FunctionPass {
+struct Instrument : public ModulePass {
   static char ID;
   static const char *checkFunctionName;
 
-  Instrument() : FunctionPass(ID) {}
+  Instrument() : ModulePass(ID) {}
 
-  bool runOnFunction(Function &F) override;
+  bool runOnModule(Module &M) override;
 };
+
+/**
+ * New pass manager version of Instrument. Registered as "instrument" for
+ * `opt -passes=`; analyses cached for M are only invalidated when a check or
+ * coverage probe was actually inserted.
+ */
+struct InstrumentPass : public PassInfoMixin<InstrumentPass> {
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+};
+
+bool instrumentModule(Module &M);
+
+/// Bump element Counter of Counters right before I.
+void instrumentCoverage(Module *M, GlobalVariable *Counters, unsigned Counter,
+                        Instruction &I);
 } // namespace instrument
@@ -1,30 +1,520 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "CoverageFile.h"
+
+/* Set when a fuzzer supplied the bitmap, see the end of this file. */
+static int AflAttached;
+
+/* Reached from the cold path of the inline checks. */
+void __divzero_report(int line, int col) {
+  printf("Divide-by-zero detected at line %d and col %d\n", line, col);
+  /* A fuzzer only keeps inputs that crash the program. */
+  if (AflAttached) {
+    fflush(stdout);
+    abort();
+  }
+  exit(1);
+}
 
 void __sanitize__(int divisor, int line, int col) {
-  if (divisor == 0) {
-    printf("Divide-by-zero detected at line %d and col %d\n", line, col);
-    exit(1);
+  if (divisor == 0)
+    __divzero_report(line, col);
+}
+
+/*
+ * Coverage counters.
+ *
+ * The instrumentation counts hits inline in counters kept in the
+ * __divzero_cov_counters section, and describes every coverage site in an
+ * entry of the __divzero_cov_sites section. The count of a site is the sum
+ * of its terms, each a counter times a coefficient: with one probe per
+ * instruction that is just the site's own counter, with block or edge
+ * probes it is the count of its block worked out from the probed ones. A
+ * constructor in every instrumented module passes the bounds of the site
+ * table to __divzero_cov_init. Counts are written to <exe>.cov at exit or
+ * when a fatal signal arrives, in the format of one "line,col" line per
+ * hit, so a site hit n times shows up n times. With
+ * DIVZERO_COV_FLUSH_INTERVAL=<seconds> a thread also writes them that
+ * often; every write only adds what was counted since the one before.
+ *
+ * With DIVZERO_COV_FORMAT=binary they go to <exe>.covb instead, the fixed
+ * size file of CoverageFile.h: each run adds its counts to the ones already
+ * there, in place, so the file does not grow however long the program is
+ * run. DivZeroCovMerge merges such files and turns them back into text.
+ *
+ * Counting takes no lock. Threads only ever touch the counters, which
+ * -coverage-atomic makes relaxed atomic adds; whichever thread exits or
+ * takes a signal first writes the file, after waiting for a periodic write
+ * that may be under way; writing a binary file also locks it against other
+ * processes. A forked child starts over from zero and
+ * writes <exe>.<pid>.cov (or .covb), so every process reports only what
+ * it ran itself. A thread cannot be created safely in the fork handler, so
+ * the child's periodic writer only starts once the child next enters the
+ * runtime, from a sampled probe or a newly loaded module; until then it is
+ * written at exit.
+ */
+
+struct CoverageTerm {
+  uint64_t *Counter;
+  int64_t Coef;
+};
+
+struct CoverageSite {
+  const char *File;
+  int Line;
+  int Col;
+  const struct CoverageTerm *Terms;
+  int64_t NumTerms;
+};
+
+struct CoverageRegion {
+  const struct CoverageSite *Sites;
+  const struct CoverageSite *End;
+  /* Count of each site as of the last write. */
+  uint64_t *Written;
+};
+
+/* One per executable or shared object linking instrumented modules. */
+#define COV_MAX_REGIONS 64
+
+static struct CoverageRegion CovRegions[COV_MAX_REGIONS];
+static int CovNumRegions;
+
+static char CovExe[1024];
+/* Room for CovExe and the longest suffix, ".<pid>.covb". */
+static char CovPath[sizeof(CovExe) + 32];
+static int CovReady;
+static int CovBinary;
+static int CovWritten;
+static int CovBusy;
+static unsigned CovFlushInterval;
+/* Set in a forked child whose periodic writer has not been started yet. */
+static int CovFlushPending;
+
+static const int CovSignals[] = {SIGINT, SIGTERM, SIGHUP, SIGQUIT,
+                                 SIGSEGV, SIGBUS, SIGFPE, SIGABRT};
+
+/* Only write(2) from here on: this also runs inside signal handlers. */
+static void covWriteAll(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n <= 0)
+      return;
+    buf += n;
+    len -= n;
+  }
+}
+
+static char *covFormatInt(char *out, int value) {
+  char digits[12];
+  int n = 0;
+  unsigned v = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+  if (value < 0)
+    *out++ = '-';
+  do {
+    digits[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v);
+  while (n > 0)
+    *out++ = digits[--n];
+  return out;
+}
+
+static int64_t covSiteCount(const struct CoverageSite *site) {
+  int64_t count = 0;
+  for (int64_t t = 0; t < site->NumTerms; t++)
+    count += site->Terms[t].Coef *
+             (int64_t)__atomic_load_n(site->Terms[t].Counter, __ATOMIC_RELAXED);
+  return count > 0 ? count : 0;
+}
+
+/* What site number i of region has counted since the last write. */
+static uint64_t covSiteDelta(struct CoverageRegion *region, size_t i) {
+  uint64_t count = covSiteCount(&region->Sites[i]);
+  /* Counters read while threads bump them need not add up to a count
+     above the last one. */
+  if (count <= region->Written[i])
+    return 0;
+  uint64_t delta = count - region->Written[i];
+  region->Written[i] = count;
+  return delta;
+}
+
+static void covFlushText(int numRegions) {
+  int fd = open(CovPath, O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (fd == -1)
+    return;
+
+  char buf[1 << 16];
+  size_t used = 0;
+  for (int r = 0; r < numRegions; r++) {
+    struct CoverageRegion *region = &CovRegions[r];
+    for (size_t i = 0; region->Sites + i < region->End; i++) {
+      const struct CoverageSite *site = &region->Sites[i];
+      uint64_t count = covSiteDelta(region, i);
+      if (count == 0)
+        continue;
+      char line[32];
+      char *end = covFormatInt(line, site->Line);
+      *end++ = ',';
+      end = covFormatInt(end, site->Col);
+      *end++ = '\n';
+      size_t len = end - line;
+      for (uint64_t hit = 0; hit < count; hit++) {
+        if (used + len > sizeof(buf)) {
+          covWriteAll(fd, buf, used);
+          used = 0;
+        }
+        memcpy(buf + used, line, len);
+        used += len;
+      }
+    }
+  }
+  covWriteAll(fd, buf, used);
+  close(fd);
+}
+
+/* FNV-1a over the location of every site, in order. */
+static uint64_t covHash(int numRegions, uint64_t *numSites) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  *numSites = 0;
+  for (int r = 0; r < numRegions; r++) {
+    for (const struct CoverageSite *site = CovRegions[r].Sites;
+         site < CovRegions[r].End; site++) {
+      int32_t loc[2] = {site->Line, site->Col};
+      const unsigned char *bytes = (const unsigned char *)loc;
+      for (size_t i = 0; i < sizeof(loc); i++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+      for (const char *c = site->File; c && *c; c++)
+        hash = (hash ^ (unsigned char)*c) * 0x100000001b3ULL;
+      ++*numSites;
+    }
+  }
+  return hash;
+}
+
+static void covFlushBinary(int numRegions) {
+  uint64_t numSites;
+  uint64_t hash = covHash(numRegions, &numSites);
+  uint64_t size = covFileSize(numSites);
+
+  int fd = open(CovPath, O_RDWR | O_CREAT, 0644);
+  if (fd == -1)
+    return;
+  /* Runs of the same binary may finish at the same time. */
+  flock(fd, LOCK_EX);
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return;
+  }
+  /* A file of some other build of the program starts over. */
+  int fresh = 0;
+  if ((uint64_t)st.st_size != size) {
+    if (ftruncate(fd, 0) == -1 || ftruncate(fd, size) == -1) {
+      close(fd);
+      return;
+    }
+    fresh = 1;
+  }
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return;
+  }
+  struct CovFileHeader *header = map;
+  uint64_t *counts = (uint64_t *)(header + 1);
+  struct CovFileLoc *locs = (struct CovFileLoc *)(counts + numSites);
+  if (!fresh && (header->Magic != COV_FILE_MAGIC ||
+                 header->Version != COV_FILE_VERSION ||
+                 header->Hash != hash || header->NumSites != numSites)) {
+    memset(map, 0, size);
+    fresh = 1;
+  }
+
+  uint64_t i = 0;
+  for (int r = 0; r < numRegions; r++) {
+    struct CoverageRegion *region = &CovRegions[r];
+    for (size_t j = 0; region->Sites + j < region->End; j++, i++) {
+      if (fresh) {
+        locs[i].Line = region->Sites[j].Line;
+        locs[i].Col = region->Sites[j].Col;
+      }
+      counts[i] += covSiteDelta(region, j);
+    }
+  }
+  if (fresh) {
+    header->Magic = COV_FILE_MAGIC;
+    header->Version = COV_FILE_VERSION;
+    header->Hash = hash;
+    header->NumSites = numSites;
+  }
+  munmap(map, size);
+  close(fd);
+}
+
+static void covFlush(void) {
+  int numRegions = __atomic_load_n(&CovNumRegions, __ATOMIC_ACQUIRE);
+  if (!CovReady || numRegions == 0)
+    return;
+  if (CovBinary)
+    covFlushBinary(numRegions);
+  else
+    covFlushText(numRegions);
+}
+
+/* Writes never overlap. The periodic writer blocks all signals, so the
+   lock is never held by a thread stopped in a signal handler. */
+static void covLock(void) {
+  while (__atomic_exchange_n(&CovBusy, 1, __ATOMIC_ACQUIRE))
+    sched_yield();
+}
+
+static void covUnlock(void) { __atomic_store_n(&CovBusy, 0, __ATOMIC_RELEASE); }
+
+static void covAtExit(void) {
+  if (__atomic_exchange_n(&CovWritten, 1, __ATOMIC_ACQ_REL))
+    return;
+  covLock();
+  covFlush();
+  covUnlock();
+}
+
+static void *covPeriodicFlush(void *arg) {
+  (void)arg;
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, NULL);
+  for (;;) {
+    sleep(CovFlushInterval);
+    covLock();
+    int done = __atomic_load_n(&CovWritten, __ATOMIC_ACQUIRE);
+    if (!done)
+      covFlush();
+    covUnlock();
+    if (done)
+      return NULL;
   }
 }
 
-void __coverage__(int line, int col) {
-  char exe[1024];
-  int ret = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+static void covStartPeriodicFlush(void) {
+  pthread_t thread;
+  if (CovFlushInterval == 0 ||
+      pthread_create(&thread, NULL, covPeriodicFlush, NULL) != 0)
+    return;
+  pthread_detach(thread);
+}
+
+static void covStartPendingFlush(void) {
+  if (__atomic_load_n(&CovFlushPending, __ATOMIC_RELAXED) &&
+      __atomic_exchange_n(&CovFlushPending, 0, __ATOMIC_ACQ_REL))
+    covStartPeriodicFlush();
+}
+
+static void covOnSignal(int sig) {
+  covAtExit();
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+/* Runs in the only thread of a new child; no other thread can count yet. */
+static void covAtForkChild(void) {
+  int numRegions = __atomic_load_n(&CovNumRegions, __ATOMIC_ACQUIRE);
+  for (int r = 0; r < numRegions; r++) {
+    struct CoverageRegion *region = &CovRegions[r];
+    for (size_t i = 0; region->Sites + i < region->End; i++) {
+      const struct CoverageSite *site = &region->Sites[i];
+      for (int64_t t = 0; t < site->NumTerms; t++)
+        __atomic_store_n(site->Terms[t].Counter, 0, __ATOMIC_RELAXED);
+      region->Written[i] = 0;
+    }
+  }
+  snprintf(CovPath, sizeof(CovPath), "%s.%d.%s", CovExe, (int)getpid(),
+           CovBinary ? "covb" : "cov");
+  /* The periodic writer, if any, stayed behind in the parent, maybe
+     holding the lock. */
+  covUnlock();
+  __atomic_store_n(&CovWritten, 0, __ATOMIC_RELEASE);
+  /* pthread_create is not async-signal-safe, see covStartPendingFlush. */
+  __atomic_store_n(&CovFlushPending, CovFlushInterval != 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Sampling.
+ *
+ * With -coverage-sample a probe only counts down a budget of its thread,
+ * and calls __divzero_cov_sample when it runs out. The counter then gets
+ * CovSamplePeriod, the mean number of probe hits a sample stands for, so
+ * that counts stay estimates of the real ones, and the budget is refilled
+ * with a random length below twice the period, so that samples do not
+ * lock onto the loops of the program. DIVZERO_COV_SAMPLE_PERIOD sets the
+ * period; 1 counts every hit. Counts that edge mode works out as
+ * differences of counters get the noise of both, so sampling is best
+ * paired with instruction or block probes.
+ */
+
+#define COV_MAX_SAMPLE_PERIOD (1u << 30)
+
+__thread int32_t __divzero_cov_countdown
+    __attribute__((tls_model("initial-exec")));
+static __thread uint64_t CovSampleState;
+static uint32_t CovSamplePeriod = 1024;
+
+void __divzero_cov_sample(uint64_t *counter) {
+  /* xorshift64*, seeded per thread from where its state lives. */
+  uint64_t x = CovSampleState;
+  if (x == 0)
+    x = (uintptr_t)&CovSampleState ^ 0x9e3779b97f4a7c15ULL;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  CovSampleState = x;
+  uint32_t period = CovSamplePeriod;
+  uint32_t random = (x * 0x2545f4914f6cdd1dULL) >> 32;
+  __divzero_cov_countdown = 1 + random % (2 * period - 1);
+  __atomic_fetch_add(counter, period, __ATOMIC_RELAXED);
+  covStartPendingFlush();
+}
+
+static void covInit(void) {
+  int ret = readlink("/proc/self/exe", CovExe, sizeof(CovExe) - 1);
   if (ret == -1) {
     fprintf(stderr, "Error: Cannot find /proc/self/exe\n");
     exit(1);
   }
-  exe[ret] = 0;
+  /* A path that fills the buffer may have been cut short. */
+  if (ret == sizeof(CovExe) - 1) {
+    fprintf(stderr, "Error: Executable path too long\n");
+    exit(1);
+  }
+  CovExe[ret] = 0;
+  const char *format = getenv("DIVZERO_COV_FORMAT");
+  CovBinary = format && strcmp(format, "binary") == 0;
+  const char *interval = getenv("DIVZERO_COV_FLUSH_INTERVAL");
+  if (interval)
+    CovFlushInterval = strtoul(interval, NULL, 10);
+  const char *period = getenv("DIVZERO_COV_SAMPLE_PERIOD");
+  if (period) {
+    unsigned long value = strtoul(period, NULL, 10);
+    if (value >= 1 && value <= COV_MAX_SAMPLE_PERIOD)
+      CovSamplePeriod = value;
+  }
+  snprintf(CovPath, sizeof(CovPath), "%s.%s", CovExe,
+           CovBinary ? "covb" : "cov");
+  CovReady = 1;
+
+  atexit(covAtExit);
+  pthread_atfork(NULL, NULL, covAtForkChild);
+  for (size_t i = 0; i < sizeof(CovSignals) / sizeof(CovSignals[0]); i++) {
+    struct sigaction old;
+    /* Leave handlers the program installed itself alone. */
+    if (sigaction(CovSignals[i], NULL, &old) == 0 && old.sa_handler == SIG_DFL)
+      signal(CovSignals[i], covOnSignal);
+  }
+  covStartPeriodicFlush();
+}
+
+void __divzero_cov_init(const struct CoverageSite *sites,
+                        const struct CoverageSite *end) {
+  if (!CovReady)
+    covInit();
+  covStartPendingFlush();
+  /* Every module of an object passes the same bounds. Constructors run one
+     at a time, but the region must be complete before a flush can see it. */
+  int numRegions = __atomic_load_n(&CovNumRegions, __ATOMIC_ACQUIRE);
+  for (int r = 0; r < numRegions; r++) {
+    if (CovRegions[r].Sites == sites)
+      return;
+  }
+  if (!sites || numRegions == COV_MAX_REGIONS)
+    return;
+  uint64_t *written = calloc(end - sites, sizeof(uint64_t));
+  if (!written) {
+    fprintf(stderr, "Error: Cannot allocate coverage state\n");
+    exit(1);
+  }
+  CovRegions[numRegions].Sites = sites;
+  CovRegions[numRegions].End = end;
+  CovRegions[numRegions].Written = written;
+  __atomic_store_n(&CovNumRegions, numRegions + 1, __ATOMIC_RELEASE);
+}
 
-  char logfile[1024];
-  int len = strlen(exe);
-  strncpy(logfile, exe, len);
-  logfile[len] = 0;
-  strcat(logfile, ".cov");
-  FILE *f = fopen(logfile, "a");
-  fprintf(f, "%d,%d\n", line, col);
-  fclose(f);
+/*
+ * Fuzzing.
+ *
+ * With -coverage-mode=afl nothing is counted into files: every block bumps
+ * the byte of the 64KB bitmap below that stands for the edge it was entered
+ * through, AFL's way. Under afl-fuzz, __AFL_SHM_ID is the System V shared
+ * memory segment to use as the bitmap and fds 198 and 199 talk to the fork
+ * server: the first constructor stops here, before main, and forks a copy
+ * of the loaded program for every input instead of being exec'd again. Run
+ * on its own the program keeps a private bitmap nobody looks at.
+ */
+
+#define AFL_MAP_SIZE (1 << 16)
+#define AFL_FORKSRV_FD 198
+
+static uint8_t AflPrivateArea[AFL_MAP_SIZE];
+static int AflReady;
+
+uint8_t *__divzero_afl_area = AflPrivateArea;
+__thread uint32_t __divzero_afl_prev
+    __attribute__((tls_model("initial-exec")));
+
+/* Returns in each child, with fresh edges; the server itself never does. */
+static void aflForkServer(void) {
+  uint32_t msg = 0;
+  /* Nobody listening: not run by a fuzzer, or without a fork server. */
+  if (write(AFL_FORKSRV_FD + 1, &msg, 4) != 4)
+    return;
+
+  for (;;) {
+    if (read(AFL_FORKSRV_FD, &msg, 4) != 4)
+      _exit(1);
+    pid_t child = fork();
+    if (child < 0)
+      _exit(1);
+    if (child == 0) {
+      close(AFL_FORKSRV_FD);
+      close(AFL_FORKSRV_FD + 1);
+      __divzero_afl_prev = 0;
+      return;
+    }
+    int status;
+    if (write(AFL_FORKSRV_FD + 1, &child, 4) != 4 ||
+        waitpid(child, &status, 0) < 0 ||
+        write(AFL_FORKSRV_FD + 1, &status, 4) != 4)
+      _exit(1);
+  }
+}
+
+void __divzero_afl_init(void) {
+  if (AflReady)
+    return;
+  AflReady = 1;
+
+  const char *id = getenv("__AFL_SHM_ID");
+  if (id) {
+    void *area = shmat(atoi(id), NULL, 0);
+    if (area == (void *)-1) {
+      fprintf(stderr, "Error: Cannot attach the fuzzer's bitmap\n");
+      _exit(1);
+    }
+    __divzero_afl_area = area;
+    AflAttached = 1;
+  }
+  aflForkServer();
 }
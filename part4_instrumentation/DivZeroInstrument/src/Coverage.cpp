@@ -0,0 +1,408 @@
+#include "Coverage.h"
+#include "Instrument.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/CFG.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/RandomNumberGenerator.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include <algorithm>
+#include <map>
+#include <numeric>
+
+using namespace llvm;
+
+namespace instrument {
+
+static cl::opt<CoverageMode> Mode(
+    "coverage-mode", cl::init(CoverageMode::Instruction),
+    cl::desc("Granularity of the coverage probes"),
+    cl::values(clEnumValN(CoverageMode::Instruction, "instruction",
+                          "One probe per instruction with a debug location"),
+               clEnumValN(CoverageMode::Function, "function",
+                          "One probe per function, counting its entry"),
+               clEnumValN(CoverageMode::Block, "block",
+                          "One probe per basic block whose count cannot be "
+                          "taken from its predecessor"),
+               clEnumValN(CoverageMode::Edge, "edge",
+                          "Probes on the CFG edges off a spanning tree, "
+                          "splitting critical edges"),
+               clEnumValN(CoverageMode::Bitmap, "afl",
+                          "Hashed block-to-block edges in an AFL-compatible "
+                          "shared memory bitmap, for fuzzing")));
+
+CoverageMode getCoverageMode() { return Mode; }
+
+namespace {
+
+/// A straight-line piece of a block; segment counts are what sites report.
+struct Segment {
+  BasicBlock *BB;
+  Instruction *Begin;
+};
+
+enum EdgeKind {
+  BranchEdge, // a CFG edge, successor Succ of Term
+  NextEdge,   // into the rest of the block after a call returned
+  ReturnEdge, // from a block without successors to the exit
+  EntryEdge,  // from the exit back to the entry, counting calls
+  AbortEdge,  // from a call that never returned to the exit
+};
+
+struct FlowEdge {
+  unsigned From;
+  unsigned To;
+  EdgeKind Kind;
+  Instruction *Term;
+  unsigned Succ;
+};
+
+} // namespace
+
+/// Calls may exit the program; so do the divisor checks, through a call.
+static bool mayNotReturn(const Instruction &I) {
+  return isa<CallBase>(I) && !isa<IntrinsicInst>(I);
+}
+
+/// Edges into EH pads or out of indirect branches cannot carry a probe.
+static bool hasUnsplittableEdges(Function &F) {
+  for (BasicBlock &BB : F) {
+    const Instruction *Term = BB.getTerminator();
+    if (BB.isEHPad() || isa<IndirectBrInst>(Term) || isa<CallBrInst>(Term) ||
+        isa<InvokeInst>(Term))
+      return true;
+  }
+  return false;
+}
+
+/// Where a probe for I goes: right before it, but never among the PHIs.
+static Instruction *getProbePoint(Instruction &I) {
+  if (isa<PHINode>(I) || I.isEHPad())
+    return &*I.getParent()->getFirstInsertionPt();
+  return &I;
+}
+
+CoveragePlan::CoveragePlan(Function &F, CoverageMode Mode) {
+  if (Mode == CoverageMode::Instruction)
+    planInstructions(F);
+  else
+    planFlow(F, Mode);
+}
+
+void CoveragePlan::planInstructions(Function &F) {
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    if (!I->getDebugLoc())
+      continue;
+    Sites.emplace_back(&*I, Exprs.size());
+    Exprs.push_back({{static_cast<unsigned>(Probes.size()), 1}});
+    Probes.push_back({getProbePoint(*I), nullptr, 0});
+  }
+}
+
+void CoveragePlan::planFlow(Function &F, CoverageMode Mode) {
+  if (Mode == CoverageMode::Edge && hasUnsplittableEdges(F))
+    Mode = CoverageMode::Block;
+
+  // Cut the blocks into segments, remembering the segment of every site.
+  std::vector<Segment> Segs;
+  std::vector<bool> EndsInCall;
+  DenseMap<BasicBlock *, unsigned> FirstSeg;
+  std::vector<std::pair<Instruction *, unsigned>> SiteSegs;
+  for (BasicBlock &BB : F) {
+    FirstSeg[&BB] = Segs.size();
+    Segs.push_back({&BB, &*BB.getFirstInsertionPt()});
+    EndsInCall.push_back(false);
+    for (Instruction &I : BB) {
+      if (I.getDebugLoc())
+        SiteSegs.emplace_back(&I, Segs.size() - 1);
+      if (I.isTerminator() || !mayNotReturn(I))
+        continue;
+      EndsInCall.back() = true;
+      Segs.push_back({&BB, I.getNextNode()});
+      EndsInCall.push_back(false);
+    }
+  }
+  if (SiteSegs.empty())
+    return;
+
+  // The exit is one more node after the segments.
+  unsigned Exit = Segs.size();
+  unsigned Entry = FirstSeg[&F.getEntryBlock()];
+  std::vector<FlowEdge> Edges;
+  Edges.push_back({Exit, Entry, EntryEdge, nullptr, 0});
+  for (unsigned S = 0; S < Segs.size(); ++S) {
+    if (EndsInCall[S]) {
+      Edges.push_back({S, S + 1, NextEdge, nullptr, 0});
+      Edges.push_back({S, Exit, AbortEdge, nullptr, 0});
+      continue;
+    }
+    Instruction *Term = Segs[S].BB->getTerminator();
+    if (Term->getNumSuccessors() == 0)
+      Edges.push_back({S, Exit, ReturnEdge, Term, 0});
+    for (unsigned Succ = 0; Succ < Term->getNumSuccessors(); ++Succ)
+      Edges.push_back(
+          {S, FirstSeg[Term->getSuccessor(Succ)], BranchEdge, Term, Succ});
+  }
+
+  // Count of every segment holding a site, as an expression in Exprs.
+  DenseMap<unsigned, unsigned> SegExpr;
+  auto AddSites = [&](function_ref<CoverageExpr(unsigned)> CountOf) {
+    for (auto &Site : SiteSegs) {
+      auto It = SegExpr.find(Site.second);
+      if (It == SegExpr.end()) {
+        It = SegExpr.insert({Site.second, Exprs.size()}).first;
+        Exprs.push_back(CountOf(Site.second));
+      }
+      Sites.emplace_back(Site.first, It->second);
+    }
+  };
+
+  if (Mode == CoverageMode::Function) {
+    // only the lines that run on every call are reported
+    Probes.push_back({Segs[Entry].Begin, nullptr, 0});
+    SiteSegs.erase(std::remove_if(SiteSegs.begin(), SiteSegs.end(),
+                                  [&](const std::pair<Instruction *, unsigned>
+                                          &Site) {
+                                    return Site.second != Entry;
+                                  }),
+                   SiteSegs.end());
+    AddSites([](unsigned) { return CoverageExpr{{0, 1}}; });
+    return;
+  }
+
+  if (Mode == CoverageMode::Block) {
+    // A segment entered only from a predecessor that always falls into it
+    // runs exactly as often; everything else gets a probe.
+    std::vector<unsigned> NumIn(Exit + 1), NumOut(Exit + 1), In(Exit + 1);
+    for (unsigned E = 0; E < Edges.size(); ++E) {
+      ++NumOut[Edges[E].From];
+      ++NumIn[Edges[E].To];
+      In[Edges[E].To] = E;
+    }
+    DenseMap<unsigned, unsigned> Counter;
+    AddSites([&](unsigned S) {
+      // a chain that loops back on itself is unreachable; stop anywhere
+      for (unsigned Steps = 0; Steps < Exit; ++Steps) {
+        const FlowEdge &E = Edges[In[S]];
+        if (NumIn[S] != 1 || E.Kind == EntryEdge || NumOut[E.From] != 1 ||
+            E.From == S)
+          break;
+        S = E.From;
+      }
+      auto It = Counter.find(S);
+      if (It == Counter.end()) {
+        It = Counter.insert({S, static_cast<unsigned>(Probes.size())}).first;
+        Probes.push_back({Segs[S].Begin, nullptr, 0});
+      }
+      return CoverageExpr{{It->second, 1}};
+    });
+    return;
+  }
+
+  // Edge mode: grow a spanning tree, taking first the edges a probe cannot
+  // go on, then the ones it would have to split.
+  auto Rank = [&](const FlowEdge &E) {
+    if (E.Kind == AbortEdge)
+      return 0;
+    if (E.Kind == EntryEdge)
+      return 1;
+    if (E.Kind == BranchEdge && isCriticalEdge(E.Term, E.Succ))
+      return 2;
+    return 3;
+  };
+  std::vector<unsigned> Order(Edges.size());
+  std::iota(Order.begin(), Order.end(), 0);
+  std::stable_sort(Order.begin(), Order.end(), [&](unsigned A, unsigned B) {
+    return Rank(Edges[A]) < Rank(Edges[B]);
+  });
+
+  std::vector<unsigned> Leader(Exit + 1);
+  std::iota(Leader.begin(), Leader.end(), 0);
+  auto Find = [&](unsigned N) {
+    while (Leader[N] != N)
+      N = Leader[N] = Leader[Leader[N]];
+    return N;
+  };
+  std::vector<std::vector<unsigned>> TreeEdges(Exit + 1);
+  std::vector<unsigned> Probed;
+  for (unsigned E : Order) {
+    unsigned A = Find(Edges[E].From), B = Find(Edges[E].To);
+    if (A != B) {
+      Leader[A] = B;
+      TreeEdges[Edges[E].From].push_back(E);
+      TreeEdges[Edges[E].To].push_back(E);
+      continue;
+    }
+    // Abort edges form a star around the exit, so they all fit.
+    assert(Edges[E].Kind != AbortEdge && "abort edge left off the tree");
+    const FlowEdge &Edge = Edges[E];
+    if (Edge.Kind == ReturnEdge ||
+        (Edge.Kind == BranchEdge && Edge.Term->getNumSuccessors() == 1))
+      Probes.push_back({Edge.Term, nullptr, 0});
+    else if (Edge.Kind == BranchEdge && isCriticalEdge(Edge.Term, Edge.Succ))
+      Probes.push_back({nullptr, Edge.Term, Edge.Succ});
+    else
+      Probes.push_back({Segs[Edge.To].Begin, nullptr, 0});
+    Probed.push_back(E);
+  }
+
+  // Root the tree at the exit, and every piece of it cut off from there.
+  std::vector<unsigned> Parent(Exit + 1), ParentEdge(Exit + 1), Depth(Exit + 1);
+  std::vector<bool> Seen(Exit + 1);
+  for (unsigned Root = Exit + 1; Root-- > 0;) {
+    if (Seen[Root])
+      continue;
+    Seen[Root] = true;
+    Parent[Root] = Root;
+    std::vector<unsigned> Stack = {Root};
+    while (!Stack.empty()) {
+      unsigned N = Stack.back();
+      Stack.pop_back();
+      for (unsigned E : TreeEdges[N]) {
+        unsigned M = Edges[E].From == N ? Edges[E].To : Edges[E].From;
+        if (Seen[M])
+          continue;
+        Seen[M] = true;
+        Parent[M] = N;
+        ParentEdge[M] = E;
+        Depth[M] = Depth[N] + 1;
+        Stack.push_back(M);
+      }
+    }
+  }
+
+  // A probed edge closes a cycle with the tree path back from its target
+  // to its source; its count flows, signed by direction, through each tree
+  // edge on the way.
+  std::vector<std::map<unsigned, int64_t>> Flow(Edges.size());
+  for (unsigned C = 0; C < Probed.size(); ++C) {
+    const FlowEdge &Edge = Edges[Probed[C]];
+    Flow[Probed[C]][C] = 1;
+    unsigned X = Edge.To, Y = Edge.From;
+    while (X != Y) {
+      if (Depth[X] >= Depth[Y]) {
+        unsigned E = ParentEdge[X];
+        Flow[E][C] += Edges[E].From == X ? 1 : -1;
+        X = Parent[X];
+      } else {
+        unsigned E = ParentEdge[Y];
+        Flow[E][C] += Edges[E].To == Y ? 1 : -1;
+        Y = Parent[Y];
+      }
+    }
+  }
+
+  AddSites([&](unsigned S) {
+    std::map<unsigned, int64_t> Sum;
+    for (unsigned E = 0; E < Edges.size(); ++E) {
+      if (Edges[E].To != S)
+        continue;
+      for (auto &Term : Flow[E])
+        Sum[Term.first] += Term.second;
+    }
+    CoverageExpr Expr;
+    for (auto &Term : Sum) {
+      if (Term.second != 0)
+        Expr.push_back({Term.first, Term.second});
+    }
+    return Expr;
+  });
+}
+
+void CoveragePlan::insertProbes(GlobalVariable *Counters, unsigned First) {
+  Module *M = Counters->getParent();
+  for (unsigned C = 0; C < Probes.size(); ++C) {
+    Instruction *Point = Probes[C].Point;
+    if (!Point) {
+      BasicBlock *Split = SplitCriticalEdge(Probes[C].Term, Probes[C].Succ);
+      assert(Split && "probed edge cannot be split");
+      Point = Split->getTerminator();
+    }
+    instrumentCoverage(M, Counters, First + C, *Point);
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Fuzzing bitmap
+//
+// The probes of AFL: block B, with random ID Cur, bumps byte Cur ^ Prev of
+// the bitmap, where Prev is the ID of the block run before it shifted right
+// by one, so A -> B and B -> A land apart. Prev is kept per thread. Both
+// the bitmap pointer and Prev are defined by the runtime, and the bitmap
+// size must match its AFL_MAP_SIZE.
+//===----------------------------------------------------------------------===//
+
+static const unsigned BitmapSize = 1 << 16;
+static const char *BitmapAreaName = "__divzero_afl_area";
+static const char *BitmapPrevName = "__divzero_afl_prev";
+static const char *BitmapInitName = "__divzero_afl_init";
+/// afl-fuzz refuses targets whose binary does not contain this name.
+static const char *BitmapShmEnvName = "__AFL_SHM_ID";
+
+static GlobalVariable *getRuntimeGlobal(Module &M, StringRef Name, Type *Ty,
+                                        bool ThreadLocal) {
+  if (GlobalVariable *GV = M.getNamedGlobal(Name))
+    return GV;
+  return new GlobalVariable(M, Ty, false, GlobalValue::ExternalLinkage,
+                            nullptr, Name, nullptr,
+                            ThreadLocal ? GlobalValue::InitialExecTLSModel
+                                        : GlobalValue::NotThreadLocal);
+}
+
+bool insertBitmapProbes(Module &M) {
+  LLVMContext &Ctx = M.getContext();
+  Type *Int8Ty = Type::getInt8Ty(Ctx);
+  Type *Int32Ty = Type::getInt32Ty(Ctx);
+  GlobalVariable *Area = getRuntimeGlobal(M, BitmapAreaName,
+                                          Type::getInt8PtrTy(Ctx), false);
+  GlobalVariable *Prev = getRuntimeGlobal(M, BitmapPrevName, Int32Ty, true);
+  // seeded from the module, so a rebuild gives the blocks the same IDs
+  std::unique_ptr<RandomNumberGenerator> RNG = M.createRNG("divzero-afl");
+
+  bool Changed = false;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    for (BasicBlock &BB : F) {
+      BasicBlock::iterator Point = BB.getFirstInsertionPt();
+      if (Point == BB.end())
+        continue;
+      unsigned Cur = (*RNG)() % BitmapSize;
+      IRBuilder<> Builder(&BB, Point);
+      Builder.SetCurrentDebugLocation(DebugLoc());
+      Value *Index = Builder.CreateXor(Builder.CreateLoad(Int32Ty, Prev),
+                                       Builder.getInt32(Cur));
+      Value *Slot = Builder.CreateInBoundsGEP(
+          Int8Ty, Builder.CreateLoad(Area->getValueType(), Area),
+          Builder.CreateZExt(Index, Builder.getInt64Ty()));
+      Value *Hits = Builder.CreateLoad(Int8Ty, Slot);
+      Builder.CreateStore(Builder.CreateAdd(Hits, Builder.getInt8(1)), Slot);
+      Builder.CreateStore(Builder.getInt32(Cur >> 1), Prev);
+      Changed = true;
+    }
+  }
+  if (!Changed)
+    return false;
+
+  Constant *Str = ConstantDataArray::getString(Ctx, BitmapShmEnvName);
+  auto *Marker = new GlobalVariable(M, Str->getType(), true,
+                                    GlobalValue::PrivateLinkage, Str,
+                                    "divzero.afl.marker");
+  appendToCompilerUsed(M, {Marker});
+
+  FunctionCallee Init =
+      M.getOrInsertFunction(BitmapInitName, Type::getVoidTy(Ctx));
+  Function *Ctor =
+      Function::Create(FunctionType::get(Type::getVoidTy(Ctx), false),
+                       GlobalValue::InternalLinkage,
+                       "divzero.afl.module_ctor", M);
+  IRBuilder<> Builder(BasicBlock::Create(Ctx, "", Ctor));
+  Builder.CreateCall(Init);
+  Builder.CreateRetVoid();
+  appendToGlobalCtors(M, Ctor, 0);
+  return true;
+}
+
+} // namespace instrument
@@ -1,92 +1,529 @@
 #include "Instrument.h"
+#include "Coverage.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/ConstantRange.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include <vector>
 
 using namespace llvm;
 
 namespace instrument {
 
 static const char *SanitizerFunctionName = "__sanitize__";
-static const char *CoverageFunctionName = "__coverage__";
+static const char *ReportFunctionName = "__divzero_report";
+static const char *CoverageInitName = "__divzero_cov_init";
+static const char *SampleFunctionName = "__divzero_cov_sample";
+static const char *CountdownName = "__divzero_cov_countdown";
+static const char *CountersSection = "__divzero_cov_counters";
+static const char *SitesSection = "__divzero_cov_sites";
+
+static cl::opt<bool>
+    CoverageAtomic("coverage-atomic",
+                   cl::desc("Bump coverage counters with relaxed atomic adds, "
+                            "so threads do not lose each other's counts"));
+
+static cl::opt<bool>
+    CoverageSample("coverage-sample",
+                   cl::desc("Only record a random one in so many probe hits "
+                            "of each thread, see DIVZERO_COV_SAMPLE_PERIOD"));
+
+static cl::opt<bool>
+    SanitizeInline("sanitize-inline",
+                   cl::desc("Check divisors inline and only call the runtime "
+                            "on a cold path when one is zero"));
 
 /*
  * Implement divide-by-zero sanitizer.
  */
-void instrumentSanitize(Module *M, Function &F, Instruction &I) {
+void instrumentSanitize(Module *M, FunctionCallee sanitizerFuncDecl,
+                        Instruction &I, Instruction *CheckPoint) {
   Value *divisor = I.getOperand(1);
+  //__sanitize__ takes an int, so wider or narrower divisors are passed as
+  //whether they are nonzero, truncating could turn 1 << 32 into 0
+  if(!divisor->getType()->isIntegerTy(32)){
+    //no debug location, the check must not look like a coverage site
+    IRBuilder<> Builder(CheckPoint);
+    Builder.SetCurrentDebugLocation(DebugLoc());
+    divisor = Builder.CreateZExt(
+        Builder.CreateIsNotNull(divisor), Type::getInt32Ty(M->getContext()));
+  }
   int line = I.getDebugLoc().getLine();
   int col = I.getDebugLoc().getCol();
 
-  // declare __sanatize__ in the module (its like funciton prototype in C)
-  // since we will be calling __sanatize__ in that module, i need to declare 
-  // the types that the funciton expected in the context of that module,
-  // that why i do Type::getVoidTy(M->getContext())
-  FunctionCallee sanitizerFuncDecl = M->getOrInsertFunction(
-      SanitizerFunctionName,
-      Type::getVoidTy(M->getContext()),
-      Type::getInt32Ty(M->getContext()),
-      Type::getInt32Ty(M->getContext()),
-      Type::getInt32Ty(M->getContext())
-  );
-
   //create constants for the line and col
   Value *lineVal = ConstantInt::get(Type::getInt32Ty(M->getContext()), line);
   Value *colVal = ConstantInt::get(Type::getInt32Ty(M->getContext()), col);
   //create call to __sanatize__
-  //this will a call instruction in the module before instruction I passing
-  //lineVal, colVal and divisor as arguments
-  CallInst::Create(sanitizerFuncDecl, {divisor, lineVal, colVal}, "", &I);
+  //this will a call instruction in the module before CheckPoint (I itself
+  //unless the check was hoisted out of a loop) passing lineVal, colVal and
+  //divisor as arguments
+  CallInst::Create(sanitizerFuncDecl, {divisor, lineVal, colVal}, "",
+                   CheckPoint);
+
+}
+
+/**
+ * Check the divisor of I inline before CheckPoint: one compare and a
+ * branch, expected not to be taken, to a cold block that reports the
+ * division and never returns. Works for divisors of any integer width.
+ */
+static void instrumentSanitizeInline(FunctionCallee Report, Instruction &I,
+                                     Instruction *CheckPoint) {
+  LLVMContext &Ctx = I.getContext();
+  IRBuilder<> Builder(CheckPoint);
+  Builder.SetCurrentDebugLocation(DebugLoc());
+  Value *IsZero = Builder.CreateIsNull(I.getOperand(1));
+  Value *Expected = Builder.CreateIntrinsic(
+      Intrinsic::expect, {IsZero->getType()}, {IsZero, Builder.getFalse()});
+  // the weights also hold when nothing lowers llvm.expect, as with llc -O0
+  Instruction *Then = SplitBlockAndInsertIfThen(
+      Expected, CheckPoint, /*Unreachable=*/true,
+      MDBuilder(Ctx).createBranchWeights(1, (1U << 20) - 1));
+  Then->getParent()->setName("divzero.trap");
+  Then->setDebugLoc(DebugLoc());
+  Then->getParent()->getSinglePredecessor()->getTerminator()->setDebugLoc(
+      DebugLoc());
+  Builder.SetInsertPoint(Then);
+  const DebugLoc &Loc = I.getDebugLoc();
+  CallInst *Call = Builder.CreateCall(Report, {Builder.getInt32(Loc.getLine()),
+                                               Builder.getInt32(Loc.getCol())});
+  Call->setDoesNotReturn();
+  Call->addFnAttr(Attribute::Cold);
+}
+
+//===----------------------------------------------------------------------===//
+// Check placement
+//
+// A division by a loop-invariant divisor has the same divisor on every
+// iteration, so it is enough to check it once in the loop preheader. This
+// only keeps the program's behaviour if the check would have come first on
+// the first iteration anyway: the division must run on every trip through
+// the loop before it exits, and nothing the program could observe, nor
+// another check, may come before it.
+//
+// Checks that cannot fail are left out altogether: those of nonzero
+// constant divisors, of values an earlier check already covers, and of
+// values only reached through a branch that ruled zero out.
+//===----------------------------------------------------------------------===//
+
+static bool isDivision(const Instruction &I) {
+  return I.getOpcode() == Instruction::SDiv ||
+         I.getOpcode() == Instruction::UDiv;
+}
+
+/// Whether I could let the program be seen to do something, or stop it.
+static bool isObservable(const Instruction &I) {
+  return I.mayHaveSideEffects() || isDivision(I) ||
+         (isa<CallBase>(I) && !isa<DbgInfoIntrinsic>(I));
+}
+
+/**
+ * Whether the divisor of Div is known to be nonzero where Div runs: it is a
+ * nonzero constant, a check in Checked of the same value dominates Div, or
+ * Div can only be reached through a branch on a comparison of it with a
+ * constant whose taken side excludes zero.
+ */
+static bool isCheckRedundant(
+    Instruction &Div, DominatorTree &DT,
+    const DenseMap<Value *, SmallVector<Instruction *, 2>> &Checked) {
+  Value *Divisor = Div.getOperand(1);
+  if (auto *C = dyn_cast<ConstantInt>(Divisor))
+    return !C->isZero();
+
+  auto It = Checked.find(Divisor);
+  if (It != Checked.end()) {
+    for (Instruction *CheckPoint : It->second) {
+      if (DT.dominates(CheckPoint, &Div))
+        return true;
+    }
+  }
+
+  for (User *U : Divisor->users()) {
+    auto *Cmp = dyn_cast<ICmpInst>(U);
+    if (!Cmp)
+      continue;
+    ICmpInst::Predicate Pred = Cmp->getPredicate();
+    auto *C = dyn_cast<ConstantInt>(Cmp->getOperand(1));
+    if (Cmp->getOperand(0) != Divisor) {
+      C = dyn_cast<ConstantInt>(Cmp->getOperand(0));
+      Pred = Cmp->getSwappedPredicate();
+    }
+    if (!C)
+      continue;
+    ConstantRange Taken =
+        ConstantRange::makeExactICmpRegion(Pred, C->getValue());
+    APInt Zero(C->getBitWidth(), 0);
+    for (User *CmpUser : Cmp->users()) {
+      auto *BI = dyn_cast<BranchInst>(CmpUser);
+      if (!BI || !BI->isConditional() || BI->getCondition() != Cmp)
+        continue;
+      for (unsigned Succ = 0; Succ < 2; ++Succ) {
+        ConstantRange Range = Succ == 0 ? Taken : Taken.inverse();
+        BasicBlockEdge Edge(BI->getParent(), BI->getSuccessor(Succ));
+        if (!Range.contains(Zero) && DT.dominates(Edge, Div.getParent()))
+          return true;
+      }
+    }
+  }
+  return false;
+}
+
+/**
+ * Where the check of Div goes: the terminator of its loop's preheader if it
+ * can be hoisted there, or Div itself. Checks is where the divisions before
+ * it in the function are checked, null for those that need none.
+ */
+static Instruction *
+getCheckPoint(Instruction &Div, LoopInfo &LI, DominatorTree &DT,
+              const DenseMap<Instruction *, Instruction *> &Checks) {
+  Loop *L = LI.getLoopFor(Div.getParent());
+  if (!L || !L->getLoopPreheader() || !L->isLoopInvariant(Div.getOperand(1)))
+    return &Div;
+  Instruction *Preheader = L->getLoopPreheader()->getTerminator();
+
+  // every way out of the first iteration passes the division
+  SmallVector<BasicBlock *, 4> Exiting;
+  L->getExitingBlocks(Exiting);
+  L->getLoopLatches(Exiting);
+  for (BasicBlock *BB : Exiting) {
+    if (!DT.dominates(Div.getParent(), BB))
+      return &Div;
+  }
+
+  // and the way there is a straight line free of side effects; earlier
+  // divisions are fine if their checks come first in the preheader too, or
+  // they have none
+  auto Quiet = [&](Instruction &I) {
+    if (!isObservable(I))
+      return true;
+    auto It = Checks.find(&I);
+    return It != Checks.end() && (!It->second || It->second == Preheader);
+  };
+  BasicBlock *BB = L->getHeader();
+  for (unsigned Steps = 0; BB != Div.getParent(); ++Steps) {
+    BasicBlock *Next = BB->getSingleSuccessor();
+    if (!Next || Steps == L->getNumBlocks() ||
+        !std::all_of(BB->begin(), BB->end(), Quiet))
+      return &Div;
+    BB = Next;
+  }
+  for (Instruction *I = &BB->front(); I != &Div; I = I->getNextNode()) {
+    if (!Quiet(*I))
+      return &Div;
+  }
+  return Preheader;
+}
+
+//===----------------------------------------------------------------------===//
+// Coverage sites
+//
+// Every instruction with a debug location is a coverage site. Its count is
+// a sum of counters, set up by the function's CoveragePlan: in instruction
+// mode the site has a counter of its own, in the other modes sites share
+// counters or have their count worked out from those of other blocks. The
+// counters live in their own section, and a site table of (file, line,
+// col, terms) in another, so the tables of all modules linked into a binary
+// line up and a constructor hands their bounds to the runtime, which
+// evaluates the counts and writes them out at exit.
+//===----------------------------------------------------------------------===//
 
+/// Type of one term of a count: { i64* counter, i64 coef }.
+static StructType *getTermType(LLVMContext &Ctx) {
+  return StructType::get(Type::getInt64PtrTy(Ctx), Type::getInt64Ty(Ctx));
+}
+
+/// Type of one site table entry: { i8* file, i32 line, i32 col,
+/// term* terms, i64 num_terms }.
+static StructType *getSiteType(LLVMContext &Ctx) {
+  return StructType::get(Type::getInt8PtrTy(Ctx), Type::getInt32Ty(Ctx),
+                         Type::getInt32Ty(Ctx),
+                         getTermType(Ctx)->getPointerTo(),
+                         Type::getInt64Ty(Ctx));
+}
+
+/// Constant address of element Index of the array global GV.
+static Constant *getElement(GlobalVariable *GV, unsigned Index) {
+  Type *Int64Ty = Type::getInt64Ty(GV->getContext());
+  Constant *Indices[] = {ConstantInt::get(Int64Ty, 0),
+                         ConstantInt::get(Int64Ty, Index)};
+  return ConstantExpr::getInBoundsGetElementPtr(GV->getValueType(), GV,
+                                                Indices);
+}
+
+/**
+ * Sampled probe before I: count down the thread's budget and, only once it
+ * runs out, call the runtime on a cold path to record a sample in Address
+ * and draw a new budget. The fast path touches no shared memory.
+ */
+static void instrumentSampledCoverage(Module *M, Constant *Address,
+                                      Instruction &I) {
+  LLVMContext &Ctx = M->getContext();
+  Type *Int32Ty = Type::getInt32Ty(Ctx);
+  GlobalVariable *Countdown = M->getNamedGlobal(CountdownName);
+  if (!Countdown)
+    Countdown = new GlobalVariable(
+        *M, Int32Ty, false, GlobalValue::ExternalLinkage, nullptr,
+        CountdownName, nullptr, GlobalValue::InitialExecTLSModel);
+  FunctionCallee Sample =
+      M->getOrInsertFunction(SampleFunctionName, Type::getVoidTy(Ctx),
+                             Type::getInt64PtrTy(Ctx));
+  if (Function *F = dyn_cast<Function>(Sample.getCallee()))
+    F->addFnAttr(Attribute::Cold);
+
+  // splitting the entry block before its static allocas would make them
+  // dynamic ones; they cannot stop the program, so probe after them
+  Instruction *Point = &I;
+  while (isa<AllocaInst>(Point) && cast<AllocaInst>(Point)->isStaticAlloca())
+    Point = Point->getNextNode();
+
+  IRBuilder<> Builder(Point);
+  Value *Left = Builder.CreateSub(Builder.CreateLoad(Int32Ty, Countdown),
+                                  Builder.getInt32(1));
+  Builder.CreateStore(Left, Countdown);
+  Instruction *Then = SplitBlockAndInsertIfThen(
+      Builder.CreateICmpSLE(Left, Builder.getInt32(0)), Point,
+      /*Unreachable=*/false,
+      MDBuilder(Ctx).createBranchWeights(1, (1U << 20) - 1));
+  Then->getParent()->setName("divzero.sample");
+  Builder.SetInsertPoint(Then);
+  Builder.CreateCall(Sample, {Address});
 }
 
 /*
  * Implement code coverage instrumentation.
  */
-void instrumentCoverage(Module *M, Function &F, Instruction &I) {
-  int line = I.getDebugLoc().getLine();
-  int col = I.getDebugLoc().getCol();
+void instrumentCoverage(Module *M, GlobalVariable *Counters, unsigned Counter,
+                        Instruction &I) {
+  // the counter is a constant address, so the probe is just load, add and
+  // store, or one relaxed atomic add when threads may share it
+  Type *Int64Ty = Type::getInt64Ty(M->getContext());
+  Constant *Address = getElement(Counters, Counter);
+  if (CoverageSample) {
+    instrumentSampledCoverage(M, Address, I);
+    return;
+  }
+  IRBuilder<> Builder(&I);
+  if (CoverageAtomic) {
+    Builder.CreateAtomicRMW(AtomicRMWInst::Add, Address, Builder.getInt64(1),
+                            MaybeAlign(8), AtomicOrdering::Monotonic);
+    return;
+  }
+  LoadInst *Count = Builder.CreateLoad(Int64Ty, Address);
+  Builder.CreateStore(Builder.CreateAdd(Count, Builder.getInt64(1)), Address);
+}
 
-  // declare __coverage__ in the module (its like funciton prototype in C)
-  // since we will be calling __coverage__ in that module, i need to declare 
-  // the types that the funciton expected in the context of that module,
-  // that why i do Type::getVoidTy(M->getContext())
-  FunctionCallee coverageFuncDecl = M->getOrInsertFunction(
-      CoverageFunctionName,
-      Type::getVoidTy(M->getContext()),
-      Type::getInt32Ty(M->getContext()),
-      Type::getInt32Ty(M->getContext())
-  );
+/**
+ * Emit the counters and site table of Plans, in that order, in their
+ * sections, and a constructor registering the site table bounds with the
+ * runtime.
+ */
+static GlobalVariable *createCoverageTables(Module &M,
+                                            ArrayRef<CoveragePlan> Plans) {
+  LLVMContext &Ctx = M.getContext();
+  Type *Int32Ty = Type::getInt32Ty(Ctx);
+  Type *Int64Ty = Type::getInt64Ty(Ctx);
+  StructType *TermTy = getTermType(Ctx);
+  StructType *SiteTy = getSiteType(Ctx);
 
-  //create constants for the line and col
-  Value *lineVal = ConstantInt::get(Type::getInt32Ty(M->getContext()), line);
-  Value *colVal = ConstantInt::get(Type::getInt32Ty(M->getContext()), col);
-  //create call to __coverage__
-  //this will a call instruction in the module before instruction I passing
-  //lineVal and colVal as arguments
-  CallInst::Create(coverageFuncDecl, {lineVal, colVal}, "", &I);
+  unsigned NumCounters = 0;
+  for (const CoveragePlan &Plan : Plans)
+    NumCounters += Plan.getNumCounters();
+  ArrayType *CountersTy = ArrayType::get(Int64Ty, NumCounters);
+  GlobalVariable *Counters = new GlobalVariable(
+      M, CountersTy, false, GlobalValue::InternalLinkage,
+      Constant::getNullValue(CountersTy), "divzero.cov.counters");
+  Counters->setSection(CountersSection);
+  Counters->setAlignment(Align(8));
 
+  // All terms go in one array; a site points at the run of its count.
+  std::vector<Constant *> Terms;
+  std::vector<std::pair<unsigned, unsigned>> Runs;
+  unsigned First = 0;
+  for (const CoveragePlan &Plan : Plans) {
+    for (const CoverageExpr &Expr : Plan.getExprs()) {
+      Runs.emplace_back(Terms.size(), Expr.size());
+      for (const CoverageTerm &Term : Expr)
+        Terms.push_back(ConstantStruct::get(
+            TermTy, {getElement(Counters, First + Term.Counter),
+                     ConstantInt::get(Int64Ty, Term.Coef)}));
+    }
+    First += Plan.getNumCounters();
+  }
+  ArrayType *TermsTy = ArrayType::get(TermTy, Terms.size());
+  GlobalVariable *TermTable = new GlobalVariable(
+      M, TermsTy, true, GlobalValue::PrivateLinkage,
+      ConstantArray::get(TermsTy, Terms), "divzero.cov.terms");
+
+  StringMap<Constant *> Files;
+  std::vector<Constant *> Entries;
+  unsigned Expr = 0;
+  for (const CoveragePlan &Plan : Plans) {
+    for (auto &Site : Plan.getSites()) {
+      const DebugLoc &Loc = Site.first->getDebugLoc();
+      StringRef File = cast<DILocation>(Loc.getAsMDNode())->getFilename();
+      Constant *&Name = Files[File];
+      if (!Name) {
+        Constant *Str = ConstantDataArray::getString(Ctx, File);
+        auto *GV = new GlobalVariable(M, Str->getType(), true,
+                                      GlobalValue::PrivateLinkage, Str,
+                                      "divzero.cov.file");
+        GV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+        Name = ConstantExpr::getPointerCast(GV, Type::getInt8PtrTy(Ctx));
+      }
+      const std::pair<unsigned, unsigned> &Run = Runs[Expr + Site.second];
+      Entries.push_back(ConstantStruct::get(
+          SiteTy, {Name, ConstantInt::get(Int32Ty, Loc.getLine()),
+                   ConstantInt::get(Int32Ty, Loc.getCol()),
+                   getElement(TermTable, Run.first),
+                   ConstantInt::get(Int64Ty, Run.second)}));
+    }
+    Expr += Plan.getExprs().size();
+  }
+  ArrayType *SitesTy = ArrayType::get(SiteTy, Entries.size());
+  GlobalVariable *Table = new GlobalVariable(
+      M, SitesTy, true, GlobalValue::InternalLinkage,
+      ConstantArray::get(SitesTy, Entries), "divzero.cov.sites");
+  Table->setSection(SitesSection);
+  Table->setAlignment(Align(8));
+  appendToCompilerUsed(M, {Counters, Table});
+
+  // The linker defines these around the sections of all modules.
+  auto Bound = [&](Type *Ty, const Twine &Name) {
+    auto *GV = new GlobalVariable(M, Ty, false,
+                                  GlobalValue::ExternalWeakLinkage, nullptr,
+                                  Name);
+    GV->setVisibility(GlobalValue::HiddenVisibility);
+    return GV;
+  };
+  Value *Args[] = {Bound(SiteTy, Twine("__start_") + SitesSection),
+                   Bound(SiteTy, Twine("__stop_") + SitesSection)};
+  FunctionCallee Init =
+      M.getOrInsertFunction(CoverageInitName, Type::getVoidTy(Ctx),
+                            SiteTy->getPointerTo(), SiteTy->getPointerTo());
+  Function *Ctor =
+      Function::Create(FunctionType::get(Type::getVoidTy(Ctx), false),
+                       GlobalValue::InternalLinkage,
+                       "divzero.cov.module_ctor", M);
+  IRBuilder<> Builder(BasicBlock::Create(Ctx, "", Ctor));
+  Builder.CreateCall(Init, Args);
+  Builder.CreateRetVoid();
+  appendToGlobalCtors(M, Ctor, 0);
+  return Counters;
 }
 
-bool Instrument::runOnFunction(Function &F) {
-  Module *M = F.getParent();
-  // iterate over the basic blocks in function F
-  for (Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB) {
-    // iterate over the instructions in basic block BB
-    for (BasicBlock::iterator I = BB->begin(), E = BB->end(); I != E; ++I) {
-      //if instruction has debug info create CallInst to __coverage__
-      if(I->getDebugLoc())
-        instrumentCoverage(M, F, *I);
-      if(BinaryOperator *BO = dyn_cast<BinaryOperator>(I)){
-        if(BO->getOpcode() == Instruction::SDiv || BO->getOpcode() == Instruction::UDiv){
-          //create CallInst to __sanitize__
-          instrumentSanitize(M, F, *I);
-        }
+bool instrumentModule(Module &M) {
+  Module *Mod = &M;
+  std::vector<std::pair<Instruction *, Instruction *>> Divisions;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    DominatorTree DT(F);
+    LoopInfo LI(DT);
+    DenseMap<Instruction *, Instruction *> Checks;
+    DenseMap<Value *, SmallVector<Instruction *, 2>> Checked;
+    // iterate over the instructions in function F
+    for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+      if(!isDivision(*I) || !I->getOperand(1)->getType()->isIntegerTy())
+        continue;
+      //divisions whose divisor cannot be zero here need no check at all
+      Instruction *CheckPoint = nullptr;
+      if(!isCheckRedundant(*I, DT, Checked)){
+        CheckPoint = getCheckPoint(*I, LI, DT, Checks);
+        Checked[I->getOperand(1)].push_back(CheckPoint);
+        Divisions.emplace_back(&*I, CheckPoint);
       }
+      Checks[&*I] = CheckPoint;
+    }
+  }
+
+  // The checks go in first, so coverage sees the calls that may not return
+  // where they really are. They carry no debug location and are no sites.
+  if (!Divisions.empty() && SanitizeInline) {
+    FunctionCallee Report = M.getOrInsertFunction(
+        ReportFunctionName, Type::getVoidTy(M.getContext()),
+        Type::getInt32Ty(M.getContext()), Type::getInt32Ty(M.getContext()));
+    if (Function *F = dyn_cast<Function>(Report.getCallee())) {
+      F->setDoesNotReturn();
+      F->addFnAttr(Attribute::Cold);
+    }
+    for (auto &Div : Divisions)
+      instrumentSanitizeInline(Report, *Div.first, Div.second);
+  } else if (!Divisions.empty()) {
+    // declare __sanatize__ in the module (its like funciton prototype in C)
+    // since we will be calling __sanatize__ in that module, i need to declare
+    // the types that the funciton expected in the context of that module,
+    // that why i do Type::getVoidTy(M->getContext())
+    FunctionCallee sanitizerFuncDecl = M.getOrInsertFunction(
+        SanitizerFunctionName,
+        Type::getVoidTy(M.getContext()),
+        Type::getInt32Ty(M.getContext()),
+        Type::getInt32Ty(M.getContext()),
+        Type::getInt32Ty(M.getContext())
+    );
+    //create CallInst to __sanitize__ before every division, or in the
+    //preheader of its loop
+    for (auto &Div : Divisions)
+      instrumentSanitize(Mod, sanitizerFuncDecl, *Div.first, Div.second);
+  }
+
+  CoverageMode Mode = getCoverageMode();
+  if (Mode == CoverageMode::Bitmap)
+    return insertBitmapProbes(M) || !Divisions.empty();
+  std::vector<CoveragePlan> Plans;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    // plan the probes of every function before touching any of them
+    CoveragePlan Plan(F, Mode);
+    if (!Plan.getSites().empty())
+      Plans.push_back(std::move(Plan));
+  }
+  if (!Plans.empty()) {
+    GlobalVariable *Counters = createCoverageTables(M, Plans);
+    unsigned First = 0;
+    for (CoveragePlan &Plan : Plans) {
+      Plan.insertProbes(Counters, First);
+      First += Plan.getNumCounters();
     }
   }
-  return true;
+  return !Plans.empty() || !Divisions.empty();
 }
 
+bool Instrument::runOnModule(Module &M) { return instrumentModule(M); }
+
+PreservedAnalyses InstrumentPass::run(Module &M, ModuleAnalysisManager &MAM) {
+  if (!instrumentModule(M))
+    return PreservedAnalyses::all();
+  return PreservedAnalyses::none();
+}
 char Instrument::ID = 1;
 static RegisterPass<Instrument>
     X("Instrument", "Instrumentations for Dynamic Analysis", false, false);
 
 } // namespace instrument
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "Instrument", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name != "instrument")
+                    return false;
+                  MPM.addPass(instrument::InstrumentPass());
+                  return true;
+                });
+          }};
+}
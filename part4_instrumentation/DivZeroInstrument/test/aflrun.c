@@ -0,0 +1,88 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Plays afl-fuzz for one input: starts the program with a bitmap and the
+// fork server pipes, asks it for one child fed from stdin, and prints what
+// came back. The program's own output goes to /dev/null, as under afl-fuzz.
+
+#define FORKSRV_FD 198
+#define MAP_SIZE (1 << 16)
+
+static int readInt(int fd, int32_t *value) {
+  return read(fd, value, 4) == 4;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <program> [args...]\n", argv[0]);
+    return 2;
+  }
+  int shm = shmget(IPC_PRIVATE, MAP_SIZE, IPC_CREAT | IPC_EXCL | 0600);
+  if (shm < 0) {
+    perror("shmget");
+    return 2;
+  }
+  unsigned char *map = shmat(shm, NULL, 0);
+  if (map == (void *)-1) {
+    perror("shmat");
+    shmctl(shm, IPC_RMID, NULL);
+    return 2;
+  }
+  char id[16];
+  snprintf(id, sizeof(id), "%d", shm);
+  setenv("__AFL_SHM_ID", id, 1);
+
+  int ctl[2], st[2];
+  if (pipe(ctl) || pipe(st)) {
+    perror("pipe");
+    return 2;
+  }
+  pid_t server = fork();
+  if (server == 0) {
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+    dup2(ctl[0], FORKSRV_FD);
+    dup2(st[1], FORKSRV_FD + 1);
+    close(ctl[0]);
+    close(ctl[1]);
+    close(st[0]);
+    close(st[1]);
+    execv(argv[1], argv + 1);
+    _exit(127);
+  }
+  close(ctl[0]);
+  close(st[1]);
+
+  int32_t msg = 0, pid, status;
+  if (readInt(st[0], &msg)) {
+    printf("hello\n");
+    msg = 0;
+    if (write(ctl[1], &msg, 4) == 4 && readInt(st[0], &pid)) {
+      printf(pid > 0 && pid != server ? "pid ok\n" : "bad pid %d\n", pid);
+      if (readInt(st[0], &status)) {
+        if (WIFEXITED(status))
+          printf("child exited %d\n", WEXITSTATUS(status));
+        else if (WIFSIGNALED(status))
+          printf("child killed by signal %d\n", WTERMSIG(status));
+      }
+    }
+  }
+  int hit = 0;
+  for (int i = 0; i < MAP_SIZE; i++)
+    hit |= map[i];
+  printf(hit ? "bitmap ok\n" : "bitmap empty\n");
+
+  // With the control pipe closed the server has no more work.
+  close(ctl[1]);
+  waitpid(server, &status, 0);
+  if (WIFEXITED(status))
+    printf("server exited %d\n", WEXITSTATUS(status));
+  shmdt(map);
+  shmctl(shm, IPC_RMID, NULL);
+  return 0;
+}
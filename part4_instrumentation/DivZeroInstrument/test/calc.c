@@ -27,3 +27,8 @@ int main() {
   } while(1);
   return 0;
 }
+// AFL: hello
+// AFL: pid ok
+// AFL: child killed by signal 6
+// AFL: bitmap ok
+// AFL: server exited 1
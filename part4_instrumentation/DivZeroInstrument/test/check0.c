@@ -0,0 +1,43 @@
+#include <stdio.h>
+
+// The second division needs no check of its own: the first one's comes
+// before it on every path.
+int twice(int n, int d) {
+  int a = n / d;
+  int b = (n + 1) / d;
+  return a + b;
+}
+
+// Only divided by where it cannot be zero.
+int guarded(int n, int d) {
+  if (d != 0)
+    return n / d;
+  return 0;
+}
+
+// A nonzero constant cannot be zero either.
+int either(int n, int d) {
+  if (n > 0)
+    return n / 4;
+  return n / d;
+}
+
+// The first check is not on every path to the second division.
+int branches(int n, int d) {
+  int s = 0;
+  if (n > 0)
+    s = n / d;
+  return s + 1 / d;
+}
+
+int main() {
+  printf("%d\n", twice(6, 3) + guarded(1, 0) + either(8, 0) + branches(-1, 1));
+  return twice(1, 0); // Divide by zero
+}
+
+// CHECKS: twice entry
+// CHECKS: either if.end
+// CHECKS: branches if.then
+// CHECKS: branches if.end
+// OUTPUT: 7
+// OUTPUT: Divide-by-zero detected at line 6 and col 13
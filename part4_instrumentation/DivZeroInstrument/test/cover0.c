@@ -0,0 +1,23 @@
+#include <stdio.h>
+
+int classify(int n) {
+  if (n % 3 == 0)
+    return 0;
+  if (n % 3 == 1)
+    return n / 2;
+  return 10 / (n - 5); // Divide by zero when n is 5
+}
+
+int main() {
+  int sum = 0;
+  for (int i = 0; i < 10; i++) {
+    sum += classify(i);
+    printf("%d\n", sum);
+  }
+  return 0;
+}
+// AFL: hello
+// AFL: pid ok
+// AFL: child killed by signal 6
+// AFL: bitmap ok
+// AFL: server exited 1
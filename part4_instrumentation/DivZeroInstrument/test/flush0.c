@@ -0,0 +1,11 @@
+#include <unistd.h>
+
+// Runs for a few seconds, to be written out more than once.
+int main() {
+  int s = 0;
+  for (int i = 0; i < 3; i++) {
+    s += i;
+    sleep(1);
+  }
+  return s - 3;
+}
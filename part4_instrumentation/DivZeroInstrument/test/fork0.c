@@ -0,0 +1,20 @@
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int count(int n) {
+  int s = 0;
+  for (int i = 0; i < n; i++)
+    s += i;
+  return s;
+}
+
+// Parent and child run the same code after the fork.
+int main() {
+  int n = count(3);
+  fork();
+  n += count(4);
+  wait(NULL);
+  printf("%d\n", n);
+  return 0;
+}
@@ -0,0 +1,42 @@
+#include <stdio.h>
+
+// The divisor does not change in the loop and the division comes first on
+// every trip: one check before the loop does.
+int repeat(int n, int d) {
+  int s = 0, i = 0;
+  do {
+    s += n / d;
+    i++;
+  } while (i < n);
+  return s;
+}
+
+// The loop may not run at all, so the check stays in it.
+int upto(int n, int d) {
+  int s = 0;
+  for (int i = 0; i < n; i++)
+    s += i / d;
+  return s;
+}
+
+// Invariant too, but only divided by on odd trips.
+int odd(int n, int d) {
+  int s = 0, i = 0;
+  do {
+    if (i % 2)
+      s += n / d;
+    i++;
+  } while (i < n);
+  return s;
+}
+
+int main() {
+  printf("%d\n", repeat(3, 1) + upto(0, 0) + odd(1, 0));
+  return repeat(2, 0); // Divide by zero
+}
+
+// CHECKS: repeat entry
+// CHECKS: upto for.body
+// CHECKS: odd if.then
+// OUTPUT: 9
+// OUTPUT: Divide-by-zero detected at line 8 and col 12
@@ -0,0 +1,16 @@
+#include <stdio.h>
+
+long quotient(long n, long d) {
+  return n / d;
+}
+
+int main() {
+  // Not zero, though its low 32 bits are
+  printf("%ld\n", quotient(1L << 40, 1L << 32));
+  printf("%ld\n", quotient(1, 0)); // Divide by zero
+  return 0;
+}
+
+// CHECKS: quotient entry
+// OUTPUT: 256
+// OUTPUT: Divide-by-zero detected at line 4 and col 12
@@ -0,0 +1,21 @@
+#include <pthread.h>
+
+#define THREADS 4
+
+void *work(void *arg) {
+  long s = 0;
+  for (int i = 0; i < 20000; i++)
+    s += i % 7;
+  return (void *)s;
+}
+
+int main() {
+  pthread_t threads[THREADS];
+  for (int i = 0; i < THREADS; i++)
+    pthread_create(&threads[i], NULL, work, NULL);
+  for (int i = 0; i < THREADS; i++)
+    pthread_join(threads[i], NULL);
+  return 0;
+}
+
+// HITS: 8 80000
@@ -0,0 +1,188 @@
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "CoverageFile.h"
+
+using namespace llvm;
+using namespace llvm::support;
+
+//===----------------------------------------------------------------------===//
+// Coverage file merger
+//
+// Adds up binary coverage files (.covb) written by runs of one instrumented
+// binary, e.g. by parallel test jobs, into a single file of the same
+// format, or into the text format of one "line,col" line per hit that the
+// runtime writes by default.
+//===----------------------------------------------------------------------===//
+
+static cl::list<std::string> InputPaths(cl::Positional, cl::OneOrMore,
+                                        cl::desc("<.covb files or dirs>"));
+
+static cl::opt<std::string> OutputPath("o", cl::init("-"),
+                                       cl::desc("Merged coverage file"),
+                                       cl::value_desc("filename"));
+
+static cl::opt<bool> Text("text",
+                          cl::desc("Write the merged counts as text, one "
+                                   "\"line,col\" line per hit"));
+
+namespace {
+
+/// Sum of the files merged so far.
+struct MergedCoverage {
+  uint64_t Hash = 0;
+  std::vector<uint64_t> Counts;
+  std::vector<CovFileLoc> Locs;
+  unsigned NumFiles = 0;
+};
+} // namespace
+
+/**
+ * Expand directories into the .covb files below them. Files named on the
+ * command line are taken as-is whatever their extension.
+ */
+static bool collectInputs(std::vector<std::string> &Files) {
+  for (const std::string &Path : InputPaths) {
+    if (!sys::fs::is_directory(Path)) {
+      Files.push_back(Path);
+      continue;
+    }
+    std::vector<std::string> Found;
+    std::error_code EC;
+    for (sys::fs::recursive_directory_iterator It(Path, EC), End;
+         It != End && !EC; It.increment(EC)) {
+      if (sys::path::extension(It->path()) == ".covb" &&
+          !sys::fs::is_directory(It->path()))
+        Found.push_back(It->path());
+    }
+    if (EC) {
+      errs() << "error: cannot read directory " << Path << ": "
+             << EC.message() << "\n";
+      return false;
+    }
+    std::sort(Found.begin(), Found.end());
+    Files.insert(Files.end(), Found.begin(), Found.end());
+  }
+  return true;
+}
+
+/// Counts[I] += Add[I]; a plain loop the compiler vectorises.
+static void addCounts(uint64_t *Counts, const unaligned_uint64_t *Add,
+                      size_t N) {
+  for (size_t I = 0; I < N; ++I)
+    Counts[I] += Add[I];
+}
+
+static bool mergeFile(const std::string &Path, MergedCoverage &Merged) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+      MemoryBuffer::getFile(Path, /*IsText=*/false,
+                            /*RequiresNullTerminator=*/false);
+  if (!Buffer) {
+    errs() << "error: cannot read " << Path << ": "
+           << Buffer.getError().message() << "\n";
+    return false;
+  }
+  StringRef Data = (*Buffer)->getBuffer();
+  const char *P = Data.data();
+  uint64_t Magic =
+      Data.size() < sizeof(CovFileHeader) ? 0 : endian::read64(P, native);
+  if (Magic == sys::getSwappedBytes(uint64_t(COV_FILE_MAGIC))) {
+    errs() << "error: " << Path
+           << " was written on a machine of the other byte order\n";
+    return false;
+  }
+  if (Magic != COV_FILE_MAGIC ||
+      endian::read32(P + 8, native) != COV_FILE_VERSION) {
+    errs() << "error: " << Path << " is not a coverage file\n";
+    return false;
+  }
+  uint64_t Hash = endian::read64(P + 16, native);
+  uint64_t NumSites = endian::read64(P + 24, native);
+  if (Data.size() != covFileSize(NumSites)) {
+    errs() << "error: " << Path << " is truncated\n";
+    return false;
+  }
+
+  const char *Counts = P + sizeof(CovFileHeader);
+  if (Merged.NumFiles == 0) {
+    Merged.Hash = Hash;
+    Merged.Counts.assign(NumSites, 0);
+    const char *Locs = Counts + NumSites * sizeof(uint64_t);
+    for (uint64_t I = 0; I < NumSites; ++I)
+      Merged.Locs.push_back(
+          {static_cast<int32_t>(endian::read32(Locs + 8 * I, native)),
+           static_cast<int32_t>(endian::read32(Locs + 8 * I + 4, native))});
+  } else if (Hash != Merged.Hash || NumSites != Merged.Counts.size()) {
+    errs() << "error: " << Path
+           << " was written by a different build of the program\n";
+    return false;
+  }
+  addCounts(Merged.Counts.data(),
+            reinterpret_cast<const unaligned_uint64_t *>(Counts), NumSites);
+  ++Merged.NumFiles;
+  return true;
+}
+
+static void writeBinary(const MergedCoverage &Merged, raw_ostream &OS) {
+  endian::Writer W(OS, native);
+  W.write<uint64_t>(COV_FILE_MAGIC);
+  W.write<uint32_t>(COV_FILE_VERSION);
+  W.write<uint32_t>(0);
+  W.write<uint64_t>(Merged.Hash);
+  W.write<uint64_t>(Merged.Counts.size());
+  for (uint64_t Count : Merged.Counts)
+    W.write<uint64_t>(Count);
+  for (const CovFileLoc &Loc : Merged.Locs) {
+    W.write<int32_t>(Loc.Line);
+    W.write<int32_t>(Loc.Col);
+  }
+}
+
+static void writeText(const MergedCoverage &Merged, raw_ostream &OS) {
+  for (size_t I = 0; I < Merged.Counts.size(); ++I) {
+    std::string Line = std::to_string(Merged.Locs[I].Line) + "," +
+                       std::to_string(Merged.Locs[I].Col) + "\n";
+    for (uint64_t Hit = 0; Hit < Merged.Counts[I]; ++Hit)
+      OS << Line;
+  }
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "Merge binary coverage files\n");
+
+  std::vector<std::string> Files;
+  if (!collectInputs(Files))
+    return 1;
+
+  MergedCoverage Merged;
+  for (const std::string &Path : Files) {
+    if (!mergeFile(Path, Merged))
+      return 1;
+  }
+  if (Merged.NumFiles == 0) {
+    errs() << "error: no coverage files found\n";
+    return 1;
+  }
+
+  std::error_code EC;
+  raw_fd_ostream Out(OutputPath, EC,
+                     Text ? sys::fs::OF_Text : sys::fs::OF_None);
+  if (EC) {
+    errs() << "error: cannot open " << OutputPath << ": " << EC.message()
+           << "\n";
+    return 1;
+  }
+  if (Text)
+    writeText(Merged, Out);
+  else
+    writeBinary(Merged, Out);
+  return 0;
+}